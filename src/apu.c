@@ -1,12 +1,99 @@
 #include "apu.h"
+#include "apu/blip.h"
+#include "mem.h"
+#include "cpu.h"
+#include "sched.h"
 #include <stdlib.h>
 
+static const uint8_t length_table[32] =
+{
+	10, 254, 20,  2, 40,  4, 80,  6, 160,  8, 60, 10, 14, 12, 26, 14,
+	12,  16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30,
+};
+
+static const uint8_t duty_table[4][8] =
+{
+	{0, 1, 0, 0, 0, 0, 0, 0},
+	{0, 1, 1, 0, 0, 0, 0, 0},
+	{0, 1, 1, 1, 1, 0, 0, 0},
+	{1, 0, 0, 1, 1, 1, 1, 1},
+};
+
+static const uint8_t triangle_table[32] =
+{
+	15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
+};
+
+static const uint16_t noise_periods[16] =
+{
+	4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068,
+};
+
+static const uint16_t dmc_periods[16] =
+{
+	428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54,
+};
+
+/* frame sequencer steps from the sequence start, the last entry of each
+ * mode is the sequence length
+ */
+static const uint16_t seq_steps[2][6] =
+{
+	{7457, 14913, 22371, 29829, 29830},
+	{7457, 14913, 22371, 29829, 37281, 37282},
+};
+
+/* mixer output in blip units, indexed by pulse1 + pulse2 and by
+ * 3 * triangle + 2 * noise + dmc, built at compile time so that cores on
+ * other threads never see them half filled
+ */
+#define MIX_PULSE(i) (int32_t)(95.52 / (8128.0 / (i) + 100.0) * APU_VOLUME)
+#define MIX_TND(i) (int32_t)(163.67 / (24329.0 / (i) + 100.0) * APU_VOLUME)
+#define MIX_2(f, i) f(i), f((i) + 1)
+#define MIX_10(f, i) MIX_2(f, i), MIX_2(f, (i) + 2), MIX_2(f, (i) + 4), \
+                     MIX_2(f, (i) + 6), MIX_2(f, (i) + 8)
+#define MIX_100(f, i) MIX_10(f, i), MIX_10(f, (i) + 10), \
+                      MIX_10(f, (i) + 20), MIX_10(f, (i) + 30), \
+                      MIX_10(f, (i) + 40), MIX_10(f, (i) + 50), \
+                      MIX_10(f, (i) + 60), MIX_10(f, (i) + 70), \
+                      MIX_10(f, (i) + 80), MIX_10(f, (i) + 90)
+
+static const int32_t pulse_table[31] =
+{
+	0, MIX_10(MIX_PULSE, 1), MIX_10(MIX_PULSE, 11), MIX_10(MIX_PULSE, 21),
+};
+
+static const int32_t tnd_table[203] =
+{
+	0, MIX_100(MIX_TND, 1), MIX_100(MIX_TND, 101), MIX_2(MIX_TND, 201),
+};
+
 apu_t *apu_new(mem_t *mem)
 {
 	apu_t *apu = calloc(sizeof(*apu), 1);
 	if (!apu)
 		return NULL;
 	apu->mem = mem;
+	apu->blip = apu_blip_new(APU_BLIP_LENGTH);
+	if (!apu->blip
+	 || apu_blip_set_rates(apu->blip, APU_CLOCK_RATE, APU_SAMPLE_RATE))
+	{
+		apu_blip_del(apu->blip);
+		free(apu);
+		return NULL;
+	}
+	apu->seq_next = seq_steps[0][0];
+	apu->pulse[0].next = APU_NEVER;
+	apu->pulse[1].next = APU_NEVER;
+	apu->triangle.next = APU_NEVER;
+	apu->noise.next = APU_NEVER;
+	apu->noise.lfsr = 1;
+	apu->noise.period = noise_periods[0];
+	apu->dmc.period = dmc_periods[0];
+	apu->dmc.next = apu->dmc.period;
+	apu->dmc.bits = 8;
+	apu->dmc.silence = 1;
 	return apu;
 }
 
@@ -14,5 +101,529 @@ void apu_del(apu_t *apu)
 {
 	if (!apu)
 		return;
+	apu_blip_del(apu->blip);
 	free(apu);
 }
+
+static void update_irq(apu_t *apu)
+{
+	if (apu->frame_irq || apu->dmc_irq)
+		cpu_irq_set(apu->cpu, CPU_IRQ_APU);
+	else
+		cpu_irq_clear(apu->cpu, CPU_IRQ_APU);
+}
+
+static uint8_t envelope_volume(const apu_envelope_t *envelope)
+{
+	return envelope->constant ? envelope->volume : envelope->decay;
+}
+
+static void envelope_clock(apu_envelope_t *envelope)
+{
+	if (envelope->start)
+	{
+		envelope->start = 0;
+		envelope->decay = 15;
+		envelope->divider = envelope->volume;
+		return;
+	}
+	if (envelope->divider)
+	{
+		envelope->divider--;
+		return;
+	}
+	envelope->divider = envelope->volume;
+	if (envelope->decay)
+		envelope->decay--;
+	else if (envelope->loop)
+		envelope->decay = 15;
+}
+
+/* pulse 1 negates with ones' complement */
+static uint16_t pulse_target(const apu_pulse_t *pulse, uint8_t id)
+{
+	uint16_t change = pulse->period >> pulse->sweep_shift;
+	if (pulse->sweep_negate)
+		return pulse->period - change - (id ? 0 : 1);
+	return pulse->period + change;
+}
+
+static int pulse_muted(const apu_pulse_t *pulse, uint8_t id)
+{
+	if (pulse->period < 8)
+		return 1;
+	return !pulse->sweep_negate && pulse_target(pulse, id) > 0x7FF;
+}
+
+static void pulse_update(apu_t *apu, uint8_t id)
+{
+	apu_pulse_t *pulse = &apu->pulse[id];
+	uint8_t volume = envelope_volume(&pulse->envelope);
+	if (!pulse->length || !volume || pulse_muted(pulse, id))
+	{
+		pulse->next = APU_NEVER;
+		pulse->output = 0;
+		return;
+	}
+	if (pulse->next == APU_NEVER)
+		pulse->next = apu->cycle + (pulse->period + 1) * 2;
+	pulse->output = duty_table[pulse->duty][pulse->step] ? volume : 0;
+}
+
+static void pulse_clock(apu_t *apu, uint8_t id)
+{
+	apu_pulse_t *pulse = &apu->pulse[id];
+	pulse->step = (pulse->step + 1) & 7;
+	pulse->next += (pulse->period + 1) * 2;
+	pulse_update(apu, id);
+}
+
+static void pulse_sweep(apu_pulse_t *pulse, uint8_t id)
+{
+	if (!pulse->sweep_divider && pulse->sweep_enabled && pulse->sweep_shift
+	 && !pulse_muted(pulse, id))
+		pulse->period = pulse_target(pulse, id);
+	if (!pulse->sweep_divider || pulse->sweep_reload)
+	{
+		pulse->sweep_divider = pulse->sweep_period;
+		pulse->sweep_reload = 0;
+	}
+	else
+	{
+		pulse->sweep_divider--;
+	}
+}
+
+/* the sequencer holds its step (and so the output level) when halted */
+static void triangle_update(apu_t *apu)
+{
+	apu_triangle_t *triangle = &apu->triangle;
+	if (!triangle->length || !triangle->linear || triangle->period < 2)
+		triangle->next = APU_NEVER;
+	else if (triangle->next == APU_NEVER)
+		triangle->next = apu->cycle + triangle->period + 1;
+	triangle->output = triangle_table[triangle->step];
+}
+
+static void triangle_clock(apu_t *apu)
+{
+	apu_triangle_t *triangle = &apu->triangle;
+	triangle->step = (triangle->step + 1) & 31;
+	triangle->next += triangle->period + 1;
+	triangle_update(apu);
+}
+
+static void noise_update(apu_t *apu)
+{
+	apu_noise_t *noise = &apu->noise;
+	uint8_t volume = envelope_volume(&noise->envelope);
+	if (!noise->length || !volume)
+	{
+		noise->next = APU_NEVER;
+		noise->output = 0;
+		return;
+	}
+	if (noise->next == APU_NEVER)
+		noise->next = apu->cycle + noise->period;
+	noise->output = (noise->lfsr & 1) ? 0 : volume;
+}
+
+static void noise_clock(apu_t *apu)
+{
+	apu_noise_t *noise = &apu->noise;
+	uint16_t feedback = (noise->lfsr ^ (noise->lfsr >> (noise->mode ? 6 : 1))) & 1;
+	noise->lfsr = (noise->lfsr >> 1) | (feedback << 14);
+	noise->next += noise->period;
+	noise_update(apu);
+}
+
+static void dmc_restart(apu_dmc_t *dmc)
+{
+	dmc->cur_addr = dmc->addr;
+	dmc->bytes = dmc->length;
+}
+
+/* XXX the cpu isn't stalled by the sample fetches */
+static void dmc_fetch(apu_t *apu)
+{
+	apu_dmc_t *dmc = &apu->dmc;
+	if (dmc->buffer_full || !dmc->bytes)
+		return;
+	dmc->buffer = mem_get(apu->mem, dmc->cur_addr);
+	dmc->buffer_full = 1;
+	dmc->cur_addr = dmc->cur_addr == 0xFFFF ? 0x8000 : dmc->cur_addr + 1;
+	if (--dmc->bytes)
+		return;
+	if (dmc->loop)
+	{
+		dmc_restart(dmc);
+	}
+	else if (dmc->irq_enabled)
+	{
+		apu->dmc_irq = 1;
+		update_irq(apu);
+	}
+}
+
+static void dmc_clock(apu_t *apu)
+{
+	apu_dmc_t *dmc = &apu->dmc;
+	if (!dmc->silence)
+	{
+		if (dmc->shift & 1)
+		{
+			if (dmc->output <= 125)
+				dmc->output += 2;
+		}
+		else
+		{
+			if (dmc->output >= 2)
+				dmc->output -= 2;
+		}
+	}
+	dmc->shift >>= 1;
+	if (!--dmc->bits)
+	{
+		dmc->bits = 8;
+		if (dmc->buffer_full)
+		{
+			dmc->silence = 0;
+			dmc->shift = dmc->buffer;
+			dmc->buffer_full = 0;
+			dmc_fetch(apu);
+		}
+		else
+		{
+			dmc->silence = 1;
+		}
+	}
+	dmc->next += dmc->period;
+}
+
+static void update_channels(apu_t *apu)
+{
+	pulse_update(apu, 0);
+	pulse_update(apu, 1);
+	triangle_update(apu);
+	noise_update(apu);
+}
+
+static void quarter_frame(apu_t *apu)
+{
+	envelope_clock(&apu->pulse[0].envelope);
+	envelope_clock(&apu->pulse[1].envelope);
+	envelope_clock(&apu->noise.envelope);
+	apu_triangle_t *triangle = &apu->triangle;
+	if (triangle->linear_reload)
+		triangle->linear = triangle->linear_period;
+	else if (triangle->linear)
+		triangle->linear--;
+	if (!triangle->control)
+		triangle->linear_reload = 0;
+}
+
+static void half_frame(apu_t *apu)
+{
+	for (uint8_t i = 0; i < 2; ++i)
+	{
+		apu_pulse_t *pulse = &apu->pulse[i];
+		if (pulse->length && !pulse->envelope.loop)
+			pulse->length--;
+		pulse_sweep(pulse, i);
+	}
+	if (apu->triangle.length && !apu->triangle.control)
+		apu->triangle.length--;
+	if (apu->noise.length && !apu->noise.envelope.loop)
+		apu->noise.length--;
+}
+
+static void seq_clock(apu_t *apu)
+{
+	uint8_t step = apu->seq_step;
+	if (apu->seq_mode)
+	{
+		if (step != 3)
+			quarter_frame(apu);
+		if (step == 1 || step == 4)
+			half_frame(apu);
+	}
+	else
+	{
+		quarter_frame(apu);
+		if (step & 1)
+			half_frame(apu);
+		if (step == 3 && !apu->irq_inhibit)
+		{
+			apu->frame_irq = 1;
+			update_irq(apu);
+		}
+	}
+	apu->seq_step++;
+	if (apu->seq_step == (apu->seq_mode ? 5 : 4))
+	{
+		apu->seq_base += seq_steps[apu->seq_mode][apu->seq_step];
+		apu->seq_step = 0;
+	}
+	apu->seq_next = apu->seq_base + seq_steps[apu->seq_mode][apu->seq_step];
+	update_channels(apu);
+}
+
+static void mix(apu_t *apu)
+{
+	int32_t level = pulse_table[apu->pulse[0].output + apu->pulse[1].output]
+	              + tnd_table[3 * apu->triangle.output
+	                        + 2 * apu->noise.output
+	                        + apu->dmc.output];
+	if (level == apu->level)
+		return;
+	apu_blip_add(apu->blip, apu->cycle - apu->frame_start, level - apu->level);
+	apu->level = level;
+}
+
+/* the last dmc fetch happens on the reload of the shift register that
+ * consumes the second to last byte, reloads are 8 clocks apart
+ */
+static uint64_t dmc_irq_cycle(const apu_dmc_t *dmc)
+{
+	if (!dmc->irq_enabled || dmc->loop || !dmc->bytes)
+		return APU_NEVER;
+	return dmc->next + (dmc->bits - 1 + (dmc->bytes - 1) * 8)
+	                 * (uint64_t)dmc->period;
+}
+
+void apu_schedule(apu_t *apu)
+{
+	if (!apu->sched)
+		return;
+	uint64_t next = dmc_irq_cycle(&apu->dmc);
+	if (!apu->seq_mode && !apu->irq_inhibit)
+	{
+		uint64_t frame = apu->seq_base + seq_steps[0][3];
+		if (frame < next)
+			next = frame;
+	}
+	if (next == APU_NEVER)
+		sched_set(apu->sched, SCHED_APU, SCHED_NEVER);
+	else
+		sched_set(apu->sched, SCHED_APU, next * CPU_CLOCK_DIVIDER);
+}
+
+/* steps from one channel timer / sequencer event to the next, channels
+ * only meet at their own timer expirations
+ */
+void apu_sync(apu_t *apu, uint64_t cycle)
+{
+	while (1)
+	{
+		uint64_t next = apu->seq_next;
+		if (apu->pulse[0].next < next)
+			next = apu->pulse[0].next;
+		if (apu->pulse[1].next < next)
+			next = apu->pulse[1].next;
+		if (apu->triangle.next < next)
+			next = apu->triangle.next;
+		if (apu->noise.next < next)
+			next = apu->noise.next;
+		if (apu->dmc.next < next)
+			next = apu->dmc.next;
+		if (next >= cycle)
+			break;
+		apu->cycle = next;
+		if (apu->pulse[0].next == next)
+			pulse_clock(apu, 0);
+		if (apu->pulse[1].next == next)
+			pulse_clock(apu, 1);
+		if (apu->triangle.next == next)
+			triangle_clock(apu);
+		if (apu->noise.next == next)
+			noise_clock(apu);
+		if (apu->dmc.next == next)
+			dmc_clock(apu);
+		if (apu->seq_next == next)
+			seq_clock(apu);
+		mix(apu);
+	}
+	if (cycle > apu->cycle)
+		apu->cycle = cycle;
+	apu_schedule(apu);
+}
+
+uint8_t apu_get(apu_t *apu, uint16_t addr)
+{
+	if (addr != 0x4015)
+		return 0;
+	apu_sync(apu, apu->cpu->cycles);
+	uint8_t v = 0;
+	if (apu->pulse[0].length)
+		v |= 0x01;
+	if (apu->pulse[1].length)
+		v |= 0x02;
+	if (apu->triangle.length)
+		v |= 0x04;
+	if (apu->noise.length)
+		v |= 0x08;
+	if (apu->dmc.bytes)
+		v |= 0x10;
+	if (apu->frame_irq)
+		v |= 0x40;
+	if (apu->dmc_irq)
+		v |= 0x80;
+	apu->frame_irq = 0;
+	update_irq(apu);
+	return v;
+}
+
+static void envelope_set(apu_envelope_t *envelope, uint8_t v)
+{
+	envelope->loop = (v >> 5) & 1;
+	envelope->constant = (v >> 4) & 1;
+	envelope->volume = v & 0xF;
+}
+
+void apu_set(apu_t *apu, uint16_t addr, uint8_t v)
+{
+	apu_sync(apu, apu->cpu->cycles);
+	switch (addr)
+	{
+		case 0x4000:
+		case 0x4004:
+		{
+			apu_pulse_t *pulse = &apu->pulse[(addr >> 2) & 1];
+			pulse->duty = v >> 6;
+			envelope_set(&pulse->envelope, v);
+			break;
+		}
+		case 0x4001:
+		case 0x4005:
+		{
+			apu_pulse_t *pulse = &apu->pulse[(addr >> 2) & 1];
+			pulse->sweep_enabled = v >> 7;
+			pulse->sweep_period = (v >> 4) & 0x7;
+			pulse->sweep_negate = (v >> 3) & 1;
+			pulse->sweep_shift = v & 0x7;
+			pulse->sweep_reload = 1;
+			break;
+		}
+		case 0x4002:
+		case 0x4006:
+		{
+			apu_pulse_t *pulse = &apu->pulse[(addr >> 2) & 1];
+			pulse->period = (pulse->period & 0x700) | v;
+			break;
+		}
+		case 0x4003:
+		case 0x4007:
+		{
+			apu_pulse_t *pulse = &apu->pulse[(addr >> 2) & 1];
+			pulse->period = (pulse->period & 0xFF) | ((v & 0x7) << 8);
+			if (apu->enabled & (1 << ((addr >> 2) & 1)))
+				pulse->length = length_table[v >> 3];
+			pulse->step = 0;
+			pulse->envelope.start = 1;
+			break;
+		}
+		case 0x4008:
+			apu->triangle.control = v >> 7;
+			apu->triangle.linear_period = v & 0x7F;
+			break;
+		case 0x400A:
+			apu->triangle.period = (apu->triangle.period & 0x700) | v;
+			break;
+		case 0x400B:
+			apu->triangle.period = (apu->triangle.period & 0xFF)
+			                     | ((v & 0x7) << 8);
+			if (apu->enabled & 0x04)
+				apu->triangle.length = length_table[v >> 3];
+			apu->triangle.linear_reload = 1;
+			break;
+		case 0x400C:
+			envelope_set(&apu->noise.envelope, v);
+			break;
+		case 0x400E:
+			apu->noise.mode = v >> 7;
+			apu->noise.period = noise_periods[v & 0xF];
+			break;
+		case 0x400F:
+			if (apu->enabled & 0x08)
+				apu->noise.length = length_table[v >> 3];
+			apu->noise.envelope.start = 1;
+			break;
+		case 0x4010:
+			apu->dmc.irq_enabled = v >> 7;
+			apu->dmc.loop = (v >> 6) & 1;
+			apu->dmc.period = dmc_periods[v & 0xF];
+			if (!apu->dmc.irq_enabled)
+			{
+				apu->dmc_irq = 0;
+				update_irq(apu);
+			}
+			break;
+		case 0x4011:
+			apu->dmc.output = v & 0x7F;
+			break;
+		case 0x4012:
+			apu->dmc.addr = 0xC000 | (v << 6);
+			break;
+		case 0x4013:
+			apu->dmc.length = (v << 4) | 1;
+			break;
+		case 0x4015:
+			apu->enabled = v & 0x1F;
+			if (!(v & 0x01))
+				apu->pulse[0].length = 0;
+			if (!(v & 0x02))
+				apu->pulse[1].length = 0;
+			if (!(v & 0x04))
+				apu->triangle.length = 0;
+			if (!(v & 0x08))
+				apu->noise.length = 0;
+			if (!(v & 0x10))
+			{
+				apu->dmc.bytes = 0;
+			}
+			else if (!apu->dmc.bytes)
+			{
+				dmc_restart(&apu->dmc);
+				dmc_fetch(apu);
+			}
+			apu->dmc_irq = 0;
+			update_irq(apu);
+			break;
+		case 0x4017:
+			apu->seq_mode = v >> 7;
+			apu->irq_inhibit = (v >> 6) & 1;
+			if (apu->irq_inhibit)
+			{
+				apu->frame_irq = 0;
+				update_irq(apu);
+			}
+			apu->seq_base = apu->cycle;
+			apu->seq_step = 0;
+			apu->seq_next = apu->seq_base + seq_steps[apu->seq_mode][0];
+			if (apu->seq_mode)
+			{
+				quarter_frame(apu);
+				half_frame(apu);
+			}
+			break;
+	}
+	update_channels(apu);
+	mix(apu);
+	apu_schedule(apu);
+}
+
+/* closes the blip frame at the given cycle and reads up to count samples,
+ * what the caller leaves is kept for the next frame unless it is over half
+ * of the buffer, so that the other half always fits a frame
+ */
+size_t apu_frame(apu_t *apu, uint64_t cycle, int16_t *data, size_t count)
+{
+	apu_sync(apu, cycle);
+	apu_blip_end_frame(apu->blip, apu->cycle - apu->frame_start);
+	apu->frame_start = apu->cycle;
+	size_t ret = data ? apu_blip_read(apu->blip, data, count) : 0;
+	size_t avail = apu_blip_avail(apu->blip);
+	if (avail > apu_blip_size(apu->blip) / 2)
+		apu_blip_read(apu->blip, NULL, avail);
+	return ret;
+}
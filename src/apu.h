@@ -1,14 +1,126 @@
 #ifndef APU_H
 #define APU_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+#define APU_CLOCK_RATE  (21477272.0 / 12) /* 26601712 / 16 in PAL */
+#define APU_SAMPLE_RATE 48000
+#define APU_BLIP_LENGTH 150000 /* clocks buffered, about five frames */
+#define APU_VOLUME      24000
+#define APU_NEVER       UINT64_MAX
+
+typedef struct apu_blip apu_blip_t;
+typedef struct sched sched_t;
 typedef struct mem mem_t;
+typedef struct cpu cpu_t;
+
+typedef struct apu_envelope
+{
+	uint8_t start;
+	uint8_t loop;
+	uint8_t constant;
+	uint8_t volume;
+	uint8_t divider;
+	uint8_t decay;
+} apu_envelope_t;
+
+/* channels whose output can't change don't run their timer (next is
+ * APU_NEVER) until a register write or a frame step wakes them up
+ */
+typedef struct apu_pulse
+{
+	uint64_t next;
+	apu_envelope_t envelope;
+	uint16_t period;
+	uint8_t duty;
+	uint8_t step;
+	uint8_t length;
+	uint8_t sweep_enabled;
+	uint8_t sweep_period;
+	uint8_t sweep_negate;
+	uint8_t sweep_shift;
+	uint8_t sweep_divider;
+	uint8_t sweep_reload;
+	uint8_t output;
+} apu_pulse_t;
+
+typedef struct apu_triangle
+{
+	uint64_t next;
+	uint16_t period;
+	uint8_t step;
+	uint8_t length;
+	uint8_t control;
+	uint8_t linear;
+	uint8_t linear_period;
+	uint8_t linear_reload;
+	uint8_t output;
+} apu_triangle_t;
+
+typedef struct apu_noise
+{
+	uint64_t next;
+	apu_envelope_t envelope;
+	uint16_t period;
+	uint16_t lfsr;
+	uint8_t mode;
+	uint8_t length;
+	uint8_t output;
+} apu_noise_t;
+
+typedef struct apu_dmc
+{
+	uint64_t next;
+	uint16_t period;
+	uint16_t addr;
+	uint16_t length;
+	uint16_t cur_addr;
+	uint16_t bytes;
+	uint8_t irq_enabled;
+	uint8_t loop;
+	uint8_t buffer;
+	uint8_t buffer_full;
+	uint8_t shift;
+	uint8_t bits;
+	uint8_t silence;
+	uint8_t output;
+} apu_dmc_t;
 
+/* every time is in cpu cycles, cycle is the point the apu has been run to
+ * and frame_start the cycle of the first sample of the current blip frame
+ * the apu is only run on register access, frame end and at the SCHED_APU
+ * event, which it keeps pointed at its next frame or dmc irq
+ */
 typedef struct apu
 {
 	mem_t *mem;
+	cpu_t *cpu;
+	sched_t *sched;
+	apu_blip_t *blip;
+	uint64_t cycle;
+	uint64_t frame_start;
+	uint64_t seq_base;
+	uint64_t seq_next;
+	uint8_t seq_step;
+	uint8_t seq_mode;
+	uint8_t enabled;
+	uint8_t irq_inhibit;
+	uint8_t frame_irq;
+	uint8_t dmc_irq;
+	int32_t level;
+	apu_pulse_t pulse[2];
+	apu_triangle_t triangle;
+	apu_noise_t noise;
+	apu_dmc_t dmc;
 } apu_t;
 
 apu_t *apu_new(mem_t *mem);
 void apu_del(apu_t *apu);
+void apu_sync(apu_t *apu, uint64_t cycle);
+void apu_schedule(apu_t *apu);
+uint8_t apu_get(apu_t *apu, uint16_t addr);
+void apu_set(apu_t *apu, uint16_t addr, uint8_t v);
+size_t apu_frame(apu_t *apu, uint64_t cycle, int16_t *data, size_t count);
 
 #endif
@@ -0,0 +1,129 @@
+#include "blip.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef M_PI
+# define M_PI 3.14159265358979323846
+#endif
+
+#define BASS_SHIFT 9
+
+/* blackman windowed sinc slightly below nyquist, each phase is normalized
+ * so that a full step always integrates to exactly 1 << APU_BLIP_BITS
+ */
+static void init_kernel(apu_blip_t *blip)
+{
+	const double cutoff = 0.9;
+	for (size_t p = 0; p < APU_BLIP_PHASES; ++p)
+	{
+		double v[APU_BLIP_TAPS];
+		double sum = 0;
+		for (size_t i = 0; i < APU_BLIP_TAPS; ++i)
+		{
+			double x = i - (APU_BLIP_TAPS / 2 - 1) - p / (double)APU_BLIP_PHASES;
+			double s = x ? sin(M_PI * x * cutoff) / (M_PI * x * cutoff) : 1;
+			double w = 0.42 + 0.5 * cos(2 * M_PI * x / APU_BLIP_TAPS)
+			         + 0.08 * cos(4 * M_PI * x / APU_BLIP_TAPS);
+			v[i] = s * w;
+			sum += v[i];
+		}
+		int32_t total = 0;
+		size_t peak = 0;
+		for (size_t i = 0; i < APU_BLIP_TAPS; ++i)
+		{
+			blip->kernel[p][i] = lrint(v[i] / sum * (1 << APU_BLIP_BITS));
+			total += blip->kernel[p][i];
+			if (v[i] > v[peak])
+				peak = i;
+		}
+		blip->kernel[p][peak] += (1 << APU_BLIP_BITS) - total;
+	}
+}
+
+/* the buffer is only allocated by apu_blip_set_rates */
+apu_blip_t *apu_blip_new(uint32_t length)
+{
+	apu_blip_t *blip = calloc(sizeof(*blip), 1);
+	if (!blip)
+		return NULL;
+	blip->length = length;
+	init_kernel(blip);
+	return blip;
+}
+
+void apu_blip_del(apu_blip_t *blip)
+{
+	if (!blip)
+		return;
+	free(blip->buf);
+	free(blip);
+}
+
+/* can be changed between frames (dynamic rate control), the fractional
+ * sample position carries over
+ * the buffer only grows so that the pending samples stay in place, returns
+ * -1 and keeps the previous rate if sample_rate isn't below clock_rate or
+ * the buffer can't be grown
+ */
+int apu_blip_set_rates(apu_blip_t *blip, double clock_rate,
+                       double sample_rate)
+{
+	if (!(sample_rate > 0 && sample_rate < clock_rate))
+		return -1;
+	uint64_t factor = ceil(sample_rate / clock_rate * 4294967296.0);
+	size_t size = ((blip->length * factor) >> 32) + 1 + APU_BLIP_TAPS;
+	if (size > blip->size)
+	{
+		int32_t *buf = realloc(blip->buf, size * sizeof(*buf));
+		if (!buf)
+			return -1;
+		memset(&buf[blip->size], 0, (size - blip->size) * sizeof(*buf));
+		blip->buf = buf;
+		blip->size = size;
+	}
+	blip->factor = factor;
+	return 0;
+}
+
+void apu_blip_end_frame(apu_blip_t *blip, uint32_t clocks)
+{
+	blip->offset += clocks * blip->factor;
+}
+
+size_t apu_blip_size(apu_blip_t *blip)
+{
+	return blip->size - APU_BLIP_TAPS;
+}
+
+size_t apu_blip_avail(apu_blip_t *blip)
+{
+	return blip->offset >> 32;
+}
+
+/* a NULL data drops the samples, the integrator still runs over them */
+size_t apu_blip_read(apu_blip_t *blip, int16_t *data, size_t count)
+{
+	size_t avail = apu_blip_avail(blip);
+	if (count > avail)
+		count = avail;
+	int32_t integrator = blip->integrator;
+	for (size_t i = 0; i < count; ++i)
+	{
+		int32_t s = integrator >> APU_BLIP_BITS;
+		if (s < INT16_MIN)
+			s = INT16_MIN;
+		else if (s > INT16_MAX)
+			s = INT16_MAX;
+		if (data)
+			data[i] = s;
+		integrator += blip->buf[i];
+		integrator -= s << (APU_BLIP_BITS - BASS_SHIFT);
+	}
+	blip->integrator = integrator;
+	size_t left = avail - count + APU_BLIP_TAPS;
+	memmove(blip->buf, &blip->buf[count], left * sizeof(*blip->buf));
+	memset(&blip->buf[left], 0, count * sizeof(*blip->buf));
+	blip->offset -= (uint64_t)count << 32;
+	return count;
+}
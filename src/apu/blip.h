@@ -0,0 +1,69 @@
+#ifndef APU_BLIP_H
+#define APU_BLIP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+#define APU_BLIP_PHASES 64
+#define APU_BLIP_TAPS   16
+#define APU_BLIP_BITS   15
+
+/* band-limited step synthesis: amplitude changes are added as windowed sinc
+ * impulses into a delta buffer, which is integrated back on read
+ * offset is the frame start position in samples, 32.32 fixed point
+ * length is the number of clocks the buffer holds, it is sized from it
+ * whenever the sample rate changes
+ */
+typedef struct apu_blip
+{
+	int32_t *buf;
+	size_t size;
+	uint32_t length;
+	uint64_t factor;
+	uint64_t offset;
+	int32_t integrator;
+	int16_t kernel[APU_BLIP_PHASES][APU_BLIP_TAPS];
+} apu_blip_t;
+
+apu_blip_t *apu_blip_new(uint32_t length);
+void apu_blip_del(apu_blip_t *blip);
+int apu_blip_set_rates(apu_blip_t *blip, double clock_rate,
+                       double sample_rate);
+size_t apu_blip_size(apu_blip_t *blip);
+void apu_blip_end_frame(apu_blip_t *blip, uint32_t clocks);
+size_t apu_blip_avail(apu_blip_t *blip);
+size_t apu_blip_read(apu_blip_t *blip, int16_t *data, size_t count);
+
+/* clock is relative to the current frame start, delta must fit in 16 bits
+ * so that the kernel products can be done as 16x16 -> 32 multiplies
+ */
+static inline void apu_blip_add(apu_blip_t *blip, uint32_t clock,
+                                int32_t delta)
+{
+	uint64_t pos = blip->offset + clock * blip->factor;
+	int32_t *buf = &blip->buf[pos >> 32];
+	const int16_t *kernel = blip->kernel[(pos >> 26) & (APU_BLIP_PHASES - 1)];
+#ifdef __SSE2__
+	__m128i d = _mm_set1_epi16(delta);
+	for (size_t i = 0; i < APU_BLIP_TAPS; i += 8)
+	{
+		__m128i k = _mm_loadu_si128((const __m128i*)&kernel[i]);
+		__m128i lo = _mm_mullo_epi16(k, d);
+		__m128i hi = _mm_mulhi_epi16(k, d);
+		__m128i *b = (__m128i*)&buf[i];
+		_mm_storeu_si128(&b[0], _mm_add_epi32(_mm_loadu_si128(&b[0]),
+		                                      _mm_unpacklo_epi16(lo, hi)));
+		_mm_storeu_si128(&b[1], _mm_add_epi32(_mm_loadu_si128(&b[1]),
+		                                      _mm_unpackhi_epi16(lo, hi)));
+	}
+#else
+	for (size_t i = 0; i < APU_BLIP_TAPS; ++i)
+		buf[i] += kernel[i] * delta;
+#endif
+}
+
+#endif
@@ -1,6 +1,10 @@
 #include "cpu.h"
 #include "mem.h"
+#include "sched.h"
 #include "cpu/instr.h"
+#include "cpu/trace.h"
+#include "cpu/block.h"
+#include "cpu/jit.h"
 #include <inttypes.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -11,6 +15,26 @@ cpu_t *cpu_new(mem_t *mem)
 	if (!cpu)
 		return NULL;
 	cpu->mem = mem;
+#ifdef CPU_TRACE
+	cpu->trace = cpu_trace_new(CPU_TRACE_SIZE);
+	if (!cpu->trace)
+	{
+		free(cpu);
+		return NULL;
+	}
+#endif
+#ifdef CPU_BLOCK
+	cpu->blocks = cpu_blocks_new(mem);
+	if (!cpu->blocks)
+	{
+		cpu_trace_del(cpu->trace);
+		free(cpu);
+		return NULL;
+	}
+#endif
+#ifdef CPU_JIT
+	cpu->jit = cpu_jit_new(cpu->blocks); /* stays on the interpreter without it */
+#endif
 #if 1
 	cpu->reset = 1;
 #endif
@@ -26,94 +50,107 @@ void cpu_del(cpu_t *cpu)
 {
 	if (!cpu)
 		return;
+	cpu_trace_del(cpu->trace);
+#ifdef CPU_BLOCK
+	cpu_blocks_del(cpu->blocks);
+#endif
+#ifdef CPU_JIT
+	cpu_jit_del(cpu->jit);
+#endif
 	free(cpu);
 }
 
-uint8_t cpu_peek8(cpu_t *cpu)
-{
-	return mem_get(cpu->mem, cpu->regs.pc);
-}
-
-uint16_t cpu_peek16(cpu_t *cpu)
-{
-	uint16_t lo = mem_get(cpu->mem, cpu->regs.pc + 0);
-	uint16_t hi = mem_get(cpu->mem, cpu->regs.pc + 1);
-	return lo | (hi << 8);
-}
-
-uint8_t cpu_fetch8(cpu_t *cpu)
-{
-	return mem_get(cpu->mem, cpu->regs.pc++);
-}
-
-uint16_t cpu_fetch16(cpu_t *cpu)
+/* operands crossing a page or coming from io are read ahead of the
+ * instruction into args_buf
+ */
+uint8_t cpu_fetch_opc_io(cpu_t *cpu)
 {
-	uint16_t lo = cpu_fetch8(cpu);
-	uint16_t hi = cpu_fetch8(cpu);
-	return lo | (hi << 8);
+	uint8_t opc = mem_get(cpu->mem, cpu->regs.pc++);
+	uint8_t len = cpu_instr_len[opc];
+	cpu->args_buf[0] = len > 1 ? mem_get(cpu->mem, cpu->regs.pc) : 0;
+	cpu->args_buf[1] = len > 2 ? mem_get(cpu->mem, cpu->regs.pc + 1) : 0;
+	cpu->args = cpu->args_buf;
+	return opc;
 }
 
-static void cpu_cycle(cpu_t *cpu)
+unsigned cpu_cycle(cpu_t *cpu)
 {
-	if (cpu->instr_delay)
-	{
-		cpu->instr_delay--;
-		return;
-	}
-	if (!CPU_GET_FLAG_I(cpu))
-	{
-		/* XXX IRQ */
-	}
 	const cpu_instr_t *instr;
-	uint8_t opc;
+	unsigned cycles = CPU_INSTR_INT_CYCLES;
 	if (cpu->reset)
 	{
 		instr = &instr_reset;
 		cpu->reset = 0;
-		opc = 0;
 	}
 	else if (cpu->nmi)
 	{
 		instr = &instr_nmi;
 		cpu->nmi = 0;
-		opc = 0;
+	}
+	else if (cpu->irq && !CPU_GET_FLAG_I(cpu))
+	{
+		instr = &instr_irq;
 	}
 	else
 	{
-		opc = cpu_fetch8(cpu);
+		uint8_t opc = cpu_fetch_opc(cpu);
 		instr = cpu_instr[opc];
+		cycles = cpu_instr_cycles[opc];
+		cpu->instr_cycles = cycles;
 		if (!instr)
 		{
 			printf("unknown instruction %" PRIx8 "\n", opc);
-			return;
+			cpu->cycles++;
+			return 1;
 		}
-	}
-	char tmp[256];
-	instr->print(cpu, tmp, sizeof(tmp));
-#if 1
-	printf("%-20s [OP=%02" PRIx8 " A=%02" PRIx8 " X=%02" PRIx8 " Y=%02" PRIx8
-	       " S=%02" PRIx8 " PC=%04" PRIx16 " P=%02" PRIx8 " %c%c%c%c%c%c%c]\n",
-	       tmp, opc, cpu->regs.a, cpu->regs.x, cpu->regs.y, cpu->regs.s,
-	       (uint16_t)(cpu->regs.pc - 1), cpu->regs.p,
-	       CPU_GET_FLAG_C(cpu) ? 'C' : '-',
-	       CPU_GET_FLAG_Z(cpu) ? 'Z' : '-',
-	       CPU_GET_FLAG_I(cpu) ? 'I' : '-',
-	       CPU_GET_FLAG_D(cpu) ? 'D' : '-',
-	       CPU_GET_FLAG_B(cpu) ? 'B' : '-',
-	       CPU_GET_FLAG_V(cpu) ? 'V' : '-',
-	       CPU_GET_FLAG_N(cpu) ? 'N' : '-'
-	       );
+#ifdef CPU_TRACE
+		if (cpu->trace)
+			cpu_trace_push(cpu->trace, cpu, opc);
 #endif
+	}
 	instr->exec(cpu);
+	cycles += cpu->instr_delay + cpu->stall;
+	cpu->instr_delay = 0;
+	cpu->stall = 0;
+	cpu->cycles += cycles;
+	return cycles;
 }
 
-void cpu_clock(cpu_t *cpu)
+/* runs at least one instruction, then up to the end of the scheduler slice */
+unsigned cpu_run(cpu_t *cpu)
 {
-	if (++cpu->clock_count == 12) /* 16 in PAL */
+#ifdef CPU_SWITCH
+	return cpu_instr_run(cpu);
+#else
+	unsigned count = 0;
+	do
 	{
-		cpu_cycle(cpu);
-		cpu->clock_count = 0;
-	}
+#ifdef CPU_BLOCK
+		if (!cpu->reset && !cpu->nmi
+		 && !(cpu->irq && !CPU_GET_FLAG_I(cpu)))
+		{
+			cpu_block_t *block = cpu_block_get(cpu->blocks, cpu->regs.pc);
+			if (block)
+			{
+#ifdef CPU_JIT
+				if (!block->code && cpu->jit && !cpu->trace
+				 && ++block->hits == CPU_JIT_HOT)
+					cpu_jit_compile(cpu->jit, block, cpu->regs.pc);
+				if (block->code)
+				{
+					count += cpu_jit_run(cpu, block);
+					continue;
+				}
+#endif
+				count += cpu_block_run(cpu, block);
+				continue;
+			}
+		}
+#endif
+		count += cpu_cycle(cpu);
+	} while (cpu->cycles * CPU_CLOCK_DIVIDER < cpu->sched->until);
+	return count;
+#endif
 }
 
 void cpu_nmi(cpu_t *cpu)
@@ -1,9 +1,17 @@
 #ifndef CPU_H
 #define CPU_H
 
+#include "mem.h"
 #include <stdint.h>
 
-typedef struct mem mem_t;
+#define CPU_CLOCK_DIVIDER 12 /* 16 in PAL */
+
+#define CPU_TRACE_SIZE (1 << 20)
+
+typedef struct cpu_trace cpu_trace_t;
+typedef struct cpu_blocks cpu_blocks_t;
+typedef struct cpu_jit cpu_jit_t;
+typedef struct sched sched_t;
 
 enum cpu_flag
 {
@@ -42,6 +50,13 @@ do \
 #define CPU_SET_FLAG_V(cpu, v) CPU_SET_FLAG(cpu, CPU_FLAG_V, v)
 #define CPU_SET_FLAG_N(cpu, v) CPU_SET_FLAG(cpu, CPU_FLAG_N, v)
 
+/* sources holding the shared irq line low */
+enum cpu_irq
+{
+	CPU_IRQ_MBC = (1 << 0),
+	CPU_IRQ_APU = (1 << 1),
+};
+
 typedef struct cpu_regs
 {
 	uint8_t a;
@@ -56,21 +71,92 @@ typedef struct cpu
 {
 	cpu_regs_t regs;
 	mem_t *mem;
-	uint8_t clock_count;
-	uint8_t instr_delay;
+	sched_t *sched;
+	cpu_trace_t *trace;
+	cpu_blocks_t *blocks;
+	const uint8_t *args; /* operand bytes of the current instruction */
+	uint8_t args_buf[2];
+	uint64_t cycles;
+	uint32_t instr_delay;
+	uint16_t stall;
+	uint8_t instr_cycles; /* base cycles of the running instruction */
+#ifdef CPU_IDLE
+	cpu_regs_t idle_regs; /* registers on the last backward jump */
+	uint64_t idle_cycles;
+	uint16_t idle_pc;
+#endif
+#ifdef CPU_JIT
+	cpu_jit_t *jit;
+	uint64_t jit_limit; /* cycles the compiled code has to stop at */
+	uint32_t jit_io;
+#endif
+	uint8_t irq;
 	char nmi;
 	char reset;
 } cpu_t;
 
 cpu_t *cpu_new(mem_t *mem);
 void cpu_del(cpu_t *cpu);
-void cpu_clock(cpu_t *cpu);
+unsigned cpu_cycle(cpu_t *cpu);
+unsigned cpu_run(cpu_t *cpu);
+
+static inline uint8_t cpu_peek8(cpu_t *cpu)
+{
+	return mem_get(cpu->mem, cpu->regs.pc);
+}
 
-uint8_t cpu_peek8(cpu_t *cpu);
-uint16_t cpu_peek16(cpu_t *cpu);
-uint8_t cpu_fetch8(cpu_t *cpu);
-uint16_t cpu_fetch16(cpu_t *cpu);
+static inline uint16_t cpu_peek16(cpu_t *cpu)
+{
+	uint16_t lo = mem_get(cpu->mem, cpu->regs.pc + 0);
+	uint16_t hi = mem_get(cpu->mem, cpu->regs.pc + 1);
+	return lo | (hi << 8);
+}
+
+uint8_t cpu_fetch_opc_io(cpu_t *cpu);
+
+/* the opcode fetch points args at the operand bytes, straight into the
+ * page when it holds the whole instruction
+ */
+static inline uint8_t cpu_fetch_opc(cpu_t *cpu)
+{
+	uint16_t pc = cpu->regs.pc;
+	const uint8_t *page = cpu->mem->rpages[pc >> MEM_PAGE_SHIFT];
+	if (!page || (pc & MEM_PAGE_MASK) > MEM_PAGE_SIZE - 3)
+		return cpu_fetch_opc_io(cpu);
+	cpu->regs.pc++;
+	cpu->args = &page[(pc & MEM_PAGE_MASK) + 1];
+	return page[pc & MEM_PAGE_MASK];
+}
+
+static inline uint8_t cpu_fetch8(cpu_t *cpu)
+{
+	cpu->regs.pc++;
+	return *cpu->args++;
+}
+
+static inline uint16_t cpu_fetch16(cpu_t *cpu)
+{
+	uint16_t lo = cpu_fetch8(cpu);
+	uint16_t hi = cpu_fetch8(cpu);
+	return lo | (hi << 8);
+}
 
 void cpu_nmi(cpu_t *cpu);
 
+/* cycles the cpu is halted for once the current instruction is done */
+static inline void cpu_stall(cpu_t *cpu, uint16_t cycles)
+{
+	cpu->stall += cycles;
+}
+
+static inline void cpu_irq_set(cpu_t *cpu, enum cpu_irq irq)
+{
+	cpu->irq |= irq;
+}
+
+static inline void cpu_irq_clear(cpu_t *cpu, enum cpu_irq irq)
+{
+	cpu->irq &= ~irq;
+}
+
 #endif
@@ -0,0 +1,422 @@
+#include "block.h"
+#include "instr.h"
+#include "trace.h"
+#include "../cpu.h"
+#include "../sched.h"
+#include <stdlib.h>
+
+#define BLOCK_BYTES (CPU_BLOCK_SIZE * 3) /* most bytes a block can cover */
+
+static void free_dead(cpu_blocks_t *blocks)
+{
+	while (blocks->dead)
+	{
+		cpu_block_t *next = blocks->dead->next;
+		free(blocks->dead);
+		blocks->dead = next;
+	}
+}
+
+cpu_blocks_t *cpu_blocks_new(mem_t *mem)
+{
+	cpu_blocks_t *blocks = calloc(sizeof(*blocks), 1);
+	if (!blocks)
+		return NULL;
+	blocks->mem = mem;
+	return blocks;
+}
+
+void cpu_blocks_del(cpu_blocks_t *blocks)
+{
+	if (!blocks)
+		return;
+	for (size_t i = 0; i < CPU_BLOCK_HASH; ++i)
+	{
+		cpu_block_page_t *page = blocks->pages[i];
+		while (page)
+		{
+			cpu_block_page_t *next = page->next;
+			for (size_t j = 0; j < MEM_PAGE_SIZE; ++j)
+				free(page->blocks[j]);
+			free(page);
+			page = next;
+		}
+	}
+	cpu_block_code_t *code = blocks->codes;
+	while (code)
+	{
+		cpu_block_code_t *next = code->next;
+		free(code);
+		code = next;
+	}
+	free_dead(blocks);
+	free(blocks);
+}
+
+#ifdef CPU_JIT
+/* forgets the host code of every block, for the jit to reuse its mapping */
+void cpu_blocks_drop_code(cpu_blocks_t *blocks)
+{
+	for (size_t i = 0; i < CPU_BLOCK_HASH; ++i)
+	{
+		for (cpu_block_page_t *page = blocks->pages[i]; page;
+		     page = page->next)
+		{
+			for (size_t j = 0; j < MEM_PAGE_SIZE; ++j)
+			{
+				cpu_block_t *block = page->blocks[j];
+				if (!block)
+					continue;
+				block->code = NULL;
+				block->hits = 0;
+			}
+		}
+	}
+}
+#endif
+
+static size_t page_hash(const uint8_t *data, uint8_t window)
+{
+	return (((uintptr_t)data >> MEM_PAGE_SHIFT) ^ window) % CPU_BLOCK_HASH;
+}
+
+static cpu_block_page_t *page_find(cpu_blocks_t *blocks, const uint8_t *data,
+                                   uint8_t window)
+{
+	cpu_block_page_t *page = blocks->pages[page_hash(data, window)];
+	for (; page; page = page->next)
+	{
+		if (page->data == data && page->window == window)
+			return page;
+	}
+	return NULL;
+}
+
+/* XXX pages are never dropped, roms with lots of banks mapped through
+ * lots of windows will keep all of them around
+ */
+static cpu_block_page_t *page_get(cpu_blocks_t *blocks, const uint8_t *data,
+                                  uint8_t window)
+{
+	size_t hash = page_hash(data, window);
+	cpu_block_page_t *page = page_find(blocks, data, window);
+	if (page)
+		return page;
+	page = calloc(sizeof(*page), 1);
+	if (!page)
+		return NULL;
+	page->data = data;
+	page->window = window;
+	page->next = blocks->pages[hash];
+	blocks->pages[hash] = page;
+	return page;
+}
+
+static int instr_jumps(uint8_t opc)
+{
+	switch (opc)
+	{
+		case 0x00: /* brk */
+		case 0x20: /* jsr */
+		case 0x40: /* rti */
+		case 0x4C: /* jmp */
+		case 0x60: /* rts */
+		case 0x6C: /* jmp (ind) */
+			return 1;
+		default:
+			/* branches */
+			return (opc & 0x1F) == 0x10;
+	}
+}
+
+static cpu_block_t *block_new(const uint8_t *data, uint8_t window,
+                              uint16_t addr)
+{
+	cpu_block_instr_t instr[CPU_BLOCK_SIZE];
+	uint16_t start = addr;
+	uint8_t count = 0;
+	while (count < CPU_BLOCK_SIZE)
+	{
+		uint8_t opc = data[addr];
+		uint8_t len = cpu_instr_len[opc];
+		if (addr + len > MEM_PAGE_SIZE)
+			break;
+		instr[count].exec = cpu_instr[opc]->exec;
+		instr[count].opc = opc;
+		instr[count].args[0] = len > 1 ? data[addr + 1] : 0;
+		instr[count].args[1] = len > 2 ? data[addr + 2] : 0;
+		instr[count].cycles = cpu_instr_cycles[opc];
+		instr[count].check = opc == 0x28 || opc == 0x58; /* plp, cli */
+		count++;
+		addr += len;
+		if (instr_jumps(opc))
+			break;
+	}
+	cpu_block_t *block = malloc(sizeof(*block) + sizeof(*instr) * count);
+	if (!block)
+		return NULL;
+	block->data = data;
+	block->next = NULL;
+	block->window = window;
+	block->count = count;
+	block->size = addr - start;
+	block->dead = 0;
+#ifdef CPU_JIT
+	block->code = NULL;
+	block->hits = 0;
+#endif
+	for (uint8_t i = 0; i < count; ++i)
+		block->instr[i] = instr[i];
+	return block;
+}
+
+static cpu_block_code_t *code_find(cpu_blocks_t *blocks, const uint8_t *data)
+{
+	cpu_block_code_t *code = blocks->codes;
+	for (; code; code = code->next)
+	{
+		if (code->data == data)
+			return code;
+	}
+	return NULL;
+}
+
+/* the page a written byte belongs to */
+static cpu_block_code_t *code_find_byte(cpu_blocks_t *blocks,
+                                        const uint8_t *data)
+{
+	cpu_block_code_t *code = blocks->codes;
+	for (; code; code = code->next)
+	{
+		if ((uintptr_t)data - (uintptr_t)code->data < MEM_PAGE_SIZE)
+			return code;
+	}
+	return NULL;
+}
+
+static cpu_block_code_t *code_get(cpu_blocks_t *blocks, uint8_t *data)
+{
+	cpu_block_code_t *code = code_find(blocks, data);
+	if (code)
+		return code;
+	code = calloc(sizeof(*code), 1);
+	if (!code)
+		return NULL;
+	code->data = data;
+	code->next = blocks->codes;
+	blocks->codes = code;
+	return code;
+}
+
+static void code_mark(cpu_block_code_t *code, uint16_t start, uint16_t end)
+{
+	for (uint16_t i = start; i < end; ++i)
+		code->bitmap[i / 8] |= 1 << (i % 8);
+}
+
+static int code_test(const cpu_block_code_t *code, uint16_t addr)
+{
+	return code->bitmap[addr / 8] & (1 << (addr % 8));
+}
+
+static int code_empty(const cpu_block_code_t *code, uint8_t wpage)
+{
+	for (uint16_t i = 0; i < MEM_WPAGE_SIZE / 8; ++i)
+	{
+		if (code->bitmap[wpage * (MEM_WPAGE_SIZE / 8) + i])
+			return 0;
+	}
+	return 1;
+}
+
+/* protects the wpages of start to end that weren't already */
+static void code_protect(cpu_blocks_t *blocks, cpu_block_code_t *code,
+                         uint16_t start, uint16_t end)
+{
+	for (uint16_t i = start >> MEM_WPAGE_SHIFT;
+	     i <= (end - 1) >> MEM_WPAGE_SHIFT; ++i)
+	{
+		if (code->protect & (1 << i))
+			continue;
+		code->protect |= 1 << i;
+		mem_protect(blocks->mem, &code->data[i << MEM_WPAGE_SHIFT], 1);
+	}
+}
+
+/* code from ram gets write protected, the blocks decoded from it are then
+ * invalidated by cpu_block_write
+ */
+cpu_block_t *cpu_block_get(cpu_blocks_t *blocks, uint16_t pc)
+{
+	mem_t *mem = blocks->mem;
+	uint8_t window = pc >> MEM_PAGE_SHIFT;
+	uint8_t wpage = pc >> MEM_WPAGE_SHIFT;
+	uint8_t *data = mem->rpages[window];
+	cpu_block_code_t *code = NULL;
+	free_dead(blocks);
+	if (!data)
+		return NULL;
+	if (mem->wpages[wpage] || mem->code_pages[wpage])
+	{
+		uint8_t *wdata = &data[pc & MEM_PAGE_MASK & ~MEM_WPAGE_MASK];
+		if (mem->wpages[wpage] != wdata && mem->code_pages[wpage] != wdata)
+			return NULL;
+		code = code_get(blocks, data);
+		if (!code)
+			return NULL;
+	}
+	cpu_block_page_t *page = blocks->windows[window];
+	if (!page || page->data != data)
+	{
+		page = page_get(blocks, data, window);
+		if (!page)
+			return NULL;
+		blocks->windows[window] = page;
+	}
+	cpu_block_t **block = &page->blocks[pc & MEM_PAGE_MASK];
+	if (!*block)
+	{
+		/* code rewriting itself that often is cheaper to interpret */
+		if (code && code->kills[pc & MEM_PAGE_MASK] >= CPU_BLOCK_KILLS)
+			return NULL;
+		*block = block_new(data, window, pc & MEM_PAGE_MASK);
+		if (!*block)
+			return NULL;
+		if (code && (*block)->size)
+		{
+			uint16_t start = pc & MEM_PAGE_MASK;
+			code_mark(code, start, start + (*block)->size);
+			code_protect(blocks, code, start, start + (*block)->size);
+			code->windows |= (uint64_t)1 << window;
+		}
+	}
+	if (!(*block)->count)
+		return NULL;
+	return *block;
+}
+
+/* leaves the block as soon as cpu_cycle would do something else than
+ * running its next instruction: end of the slice, pending interrupt or a
+ * bank switch under the block, all of which only io can bring mid-slice
+ */
+unsigned cpu_block_run(cpu_t *cpu, const cpu_block_t *block)
+{
+	mem_t *mem = cpu->mem;
+	uint64_t until = cpu->sched->until;
+	uint32_t io_count = mem->io_count;
+	unsigned count = 0;
+	for (uint8_t i = 0; i < block->count; ++i)
+	{
+		const cpu_block_instr_t *instr = &block->instr[i];
+		cpu->regs.pc++;
+		cpu->args = instr->args;
+		cpu->instr_cycles = instr->cycles;
+#ifdef CPU_TRACE
+		if (cpu->trace)
+			cpu_trace_push(cpu->trace, cpu, instr->opc);
+#endif
+		instr->exec(cpu);
+		unsigned cycles = instr->cycles + cpu->instr_delay + cpu->stall;
+		cpu->instr_delay = 0;
+		cpu->stall = 0;
+		cpu->cycles += cycles;
+		count += cycles;
+		if (cpu->cycles * CPU_CLOCK_DIVIDER >= until)
+			break;
+		if (mem->io_count != io_count || instr->check)
+		{
+			until = cpu->sched->until;
+			io_count = mem->io_count;
+			if (cpu->cycles * CPU_CLOCK_DIVIDER >= until
+			 || cpu->reset
+			 || cpu->nmi
+			 || (cpu->irq && !CPU_GET_FLAG_I(cpu))
+			 || mem->rpages[block->window] != block->data
+			 || block->dead)
+				break;
+		}
+	}
+	return count;
+}
+
+/* drops the blocks covering a written code byte, from every window the
+ * page is seen through, the bitmap is then rebuilt around them from the
+ * blocks left and the wpages left without code are unprotected
+ */
+void cpu_block_write(cpu_blocks_t *blocks, uint8_t *data)
+{
+	cpu_block_code_t *code = code_find_byte(blocks, data);
+	if (!code)
+		return;
+	uint16_t addr = data - code->data;
+	if (!code_test(code, addr))
+		return;
+	uint16_t first = addr >= BLOCK_BYTES ? addr - BLOCK_BYTES + 1 : 0;
+	uint16_t lo = addr;
+	uint16_t hi = addr + 1;
+	for (size_t window = 0; window < MEM_PAGE_COUNT; ++window)
+	{
+		if (!(code->windows & ((uint64_t)1 << window)))
+			continue;
+		cpu_block_page_t *page = page_find(blocks, code->data, window);
+		if (!page)
+			continue;
+		for (uint16_t start = first; start <= addr; ++start)
+		{
+			cpu_block_t *block = page->blocks[start];
+			if (!block || start + block->size <= addr)
+				continue;
+			if (start < lo)
+				lo = start;
+			if (start + block->size > hi)
+				hi = start + block->size;
+			page->blocks[start] = NULL;
+			block->dead = 1;
+			block->next = blocks->dead;
+			blocks->dead = block;
+			if (code->kills[start] < UINT8_MAX)
+				code->kills[start]++;
+		}
+	}
+	for (uint16_t i = lo; i < hi; ++i)
+		code->bitmap[i / 8] &= ~(1 << (i % 8));
+	first = lo >= BLOCK_BYTES ? lo - BLOCK_BYTES + 1 : 0;
+	for (size_t window = 0; window < MEM_PAGE_COUNT; ++window)
+	{
+		if (!(code->windows & ((uint64_t)1 << window)))
+			continue;
+		cpu_block_page_t *page = page_find(blocks, code->data, window);
+		if (!page)
+			continue;
+		for (uint16_t start = first; start < hi; ++start)
+		{
+			cpu_block_t *block = page->blocks[start];
+			if (!block || start + block->size <= lo)
+				continue;
+			code_mark(code, start > lo ? start : lo,
+			          start + block->size < hi ? start + block->size : hi);
+		}
+	}
+	for (uint8_t i = 0; i < MEM_PAGE_SIZE / MEM_WPAGE_SIZE; ++i)
+	{
+		if (!(code->protect & (1 << i)) || !code_empty(code, i))
+			continue;
+		code->protect &= ~(1 << i);
+		mem_protect(blocks->mem, &code->data[i << MEM_WPAGE_SHIFT], 0);
+	}
+	/* the running block may be one of them */
+	blocks->mem->io_count++;
+}
+
+/* whether data starts a wpage that is write protected for some block */
+int cpu_block_protected(cpu_blocks_t *blocks, const uint8_t *data)
+{
+	for (cpu_block_code_t *code = blocks->codes; code; code = code->next)
+	{
+		uintptr_t off = (uintptr_t)data - (uintptr_t)code->data;
+		if (off < MEM_PAGE_SIZE && !(off & MEM_WPAGE_MASK)
+		 && (code->protect & (1 << (off >> MEM_WPAGE_SHIFT))))
+			return 1;
+	}
+	return 0;
+}
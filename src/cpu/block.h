@@ -0,0 +1,84 @@
+#ifndef CPU_BLOCK_H
+#define CPU_BLOCK_H
+
+#include "../mem.h"
+#include <stdint.h>
+
+#define CPU_BLOCK_SIZE 32 /* instructions */
+#define CPU_BLOCK_HASH 256
+#define CPU_BLOCK_KILLS 4 /* rewrites of a block before it's left to cpu_cycle */
+
+typedef struct cpu cpu_t;
+
+typedef struct cpu_block_instr
+{
+	void (*exec)(cpu_t *cpu);
+	uint8_t opc;
+	uint8_t args[2];
+	uint8_t cycles;
+	uint8_t check; /* may unmask the irq */
+} cpu_block_instr_t;
+
+/* straight run of instructions ending on the first jump, the end of the
+ * window or CPU_BLOCK_SIZE, whichever comes first
+ */
+typedef struct cpu_block
+{
+	const uint8_t *data; /* bank it was decoded from */
+	struct cpu_block *next; /* in the list of dead blocks */
+	uint8_t window;
+	uint8_t count;
+	uint8_t size; /* bytes it was decoded from */
+	uint8_t dead; /* its bytes got written while it could be running */
+#ifdef CPU_JIT
+	void (*code)(cpu_t *cpu); /* host code once the block got hot */
+	uint32_t hits;
+#endif
+	cpu_block_instr_t instr[];
+} cpu_block_t;
+
+/* the blocks of one prg bank as seen through one 1KiB window, banks keep
+ * their blocks while they're switched out
+ */
+typedef struct cpu_block_page
+{
+	struct cpu_block_page *next;
+	const uint8_t *data;
+	uint8_t window;
+	cpu_block_t *blocks[MEM_PAGE_SIZE];
+} cpu_block_page_t;
+
+/* bytes of a writable page some block was decoded from, each of its wpages
+ * is only write protected while it holds some of them
+ */
+typedef struct cpu_block_code
+{
+	struct cpu_block_code *next;
+	uint8_t *data;
+	uint8_t protect; /* protected wpages, one bit each */
+	uint64_t windows; /* blocks were decoded through, one bit each */
+	uint8_t bitmap[MEM_PAGE_SIZE / 8];
+	uint8_t kills[MEM_PAGE_SIZE]; /* blocks dropped at each address */
+} cpu_block_code_t;
+
+typedef struct cpu_blocks
+{
+	mem_t *mem;
+	cpu_block_page_t *windows[MEM_PAGE_COUNT]; /* last page used by each */
+	cpu_block_page_t *pages[CPU_BLOCK_HASH];
+	cpu_block_code_t *codes;
+	cpu_block_t *dead; /* freed once no block runs */
+} cpu_blocks_t;
+
+cpu_blocks_t *cpu_blocks_new(mem_t *mem);
+void cpu_blocks_del(cpu_blocks_t *blocks);
+#ifdef CPU_JIT
+void cpu_blocks_drop_code(cpu_blocks_t *blocks);
+#endif
+
+cpu_block_t *cpu_block_get(cpu_blocks_t *blocks, uint16_t pc);
+unsigned cpu_block_run(cpu_t *cpu, const cpu_block_t *block);
+void cpu_block_write(cpu_blocks_t *blocks, uint8_t *data);
+int cpu_block_protected(cpu_blocks_t *blocks, const uint8_t *data);
+
+#endif
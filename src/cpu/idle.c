@@ -0,0 +1,209 @@
+#include "idle.h"
+#include "../cpu.h"
+#include "../gpu.h"
+#include "../mem.h"
+#include "../sched.h"
+
+#define IDLE_BODY_SIZE 32 /* bytes of code a loop can span */
+#define IDLE_ITER_CYCLES 64
+
+enum idle_mode
+{
+	IDLE_NONE,
+	IDLE_IMP,
+	IDLE_IMM,
+	IDLE_ZP,
+	IDLE_ZP_X,
+	IDLE_ZP_Y,
+	IDLE_ABS,
+	IDLE_ABS_X,
+	IDLE_ABS_Y,
+	IDLE_IND_X,
+	IDLE_IND_Y,
+};
+
+#define IDLE_MODE_MASK 0xF
+
+enum idle_write
+{
+	IDLE_WRITE_X = (1 << 4),
+	IDLE_WRITE_Y = (1 << 5),
+};
+
+/* instructions that can't touch anything but the registers and flags, with
+ * their addressing mode and the index registers they write
+ */
+static const uint8_t idle_instr[256] =
+{
+	[0x01] = IDLE_IND_X, [0x05] = IDLE_ZP, [0x09] = IDLE_IMM,
+	[0x0A] = IDLE_IMP, [0x0D] = IDLE_ABS, [0x11] = IDLE_IND_Y,
+	[0x15] = IDLE_ZP_X, [0x18] = IDLE_IMP, [0x19] = IDLE_ABS_Y,
+	[0x1D] = IDLE_ABS_X, [0x21] = IDLE_IND_X, [0x24] = IDLE_ZP,
+	[0x25] = IDLE_ZP, [0x29] = IDLE_IMM, [0x2A] = IDLE_IMP,
+	[0x2C] = IDLE_ABS, [0x2D] = IDLE_ABS, [0x31] = IDLE_IND_Y,
+	[0x35] = IDLE_ZP_X, [0x38] = IDLE_IMP, [0x39] = IDLE_ABS_Y,
+	[0x3D] = IDLE_ABS_X, [0x41] = IDLE_IND_X, [0x45] = IDLE_ZP,
+	[0x49] = IDLE_IMM, [0x4A] = IDLE_IMP, [0x4D] = IDLE_ABS,
+	[0x51] = IDLE_IND_Y, [0x55] = IDLE_ZP_X, [0x59] = IDLE_ABS_Y,
+	[0x5D] = IDLE_ABS_X, [0x61] = IDLE_IND_X, [0x65] = IDLE_ZP,
+	[0x69] = IDLE_IMM, [0x6A] = IDLE_IMP, [0x6D] = IDLE_ABS,
+	[0x71] = IDLE_IND_Y, [0x75] = IDLE_ZP_X, [0x78] = IDLE_IMP,
+	[0x79] = IDLE_ABS_Y, [0x7D] = IDLE_ABS_X, [0x88] = IDLE_IMP | IDLE_WRITE_Y,
+	[0x8A] = IDLE_IMP, [0x98] = IDLE_IMP, [0x9A] = IDLE_IMP,
+	[0xA0] = IDLE_IMM | IDLE_WRITE_Y, [0xA1] = IDLE_IND_X,
+	[0xA2] = IDLE_IMM | IDLE_WRITE_X, [0xA4] = IDLE_ZP | IDLE_WRITE_Y,
+	[0xA5] = IDLE_ZP, [0xA6] = IDLE_ZP | IDLE_WRITE_X,
+	[0xA8] = IDLE_IMP | IDLE_WRITE_Y, [0xA9] = IDLE_IMM,
+	[0xAA] = IDLE_IMP | IDLE_WRITE_X, [0xAC] = IDLE_ABS | IDLE_WRITE_Y,
+	[0xAD] = IDLE_ABS, [0xAE] = IDLE_ABS | IDLE_WRITE_X,
+	[0xB1] = IDLE_IND_Y, [0xB4] = IDLE_ZP_X | IDLE_WRITE_Y,
+	[0xB5] = IDLE_ZP_X, [0xB6] = IDLE_ZP_Y | IDLE_WRITE_X,
+	[0xB8] = IDLE_IMP, [0xB9] = IDLE_ABS_Y,
+	[0xBA] = IDLE_IMP | IDLE_WRITE_X, [0xBC] = IDLE_ABS_X | IDLE_WRITE_Y,
+	[0xBD] = IDLE_ABS_X, [0xBE] = IDLE_ABS_Y | IDLE_WRITE_X,
+	[0xC0] = IDLE_IMM, [0xC1] = IDLE_IND_X, [0xC4] = IDLE_ZP,
+	[0xC5] = IDLE_ZP, [0xC8] = IDLE_IMP | IDLE_WRITE_Y, [0xC9] = IDLE_IMM,
+	[0xCA] = IDLE_IMP | IDLE_WRITE_X, [0xCC] = IDLE_ABS, [0xCD] = IDLE_ABS,
+	[0xD1] = IDLE_IND_Y, [0xD5] = IDLE_ZP_X, [0xD8] = IDLE_IMP,
+	[0xD9] = IDLE_ABS_Y, [0xDD] = IDLE_ABS_X, [0xE0] = IDLE_IMM,
+	[0xE1] = IDLE_IND_X, [0xE4] = IDLE_ZP, [0xE5] = IDLE_ZP,
+	[0xE8] = IDLE_IMP | IDLE_WRITE_X, [0xE9] = IDLE_IMM, [0xEA] = IDLE_IMP,
+	[0xEC] = IDLE_ABS, [0xED] = IDLE_ABS, [0xF1] = IDLE_IND_Y,
+	[0xF5] = IDLE_ZP_X, [0xF8] = IDLE_IMP, [0xF9] = IDLE_ABS_Y,
+	[0xFD] = IDLE_ABS_X,
+};
+
+/* only memory and $2002 can be polled: memory can't change while the loop
+ * doesn't write and $2002 is bounded by gpu_status_next
+ */
+static int idle_read(cpu_t *cpu, uint16_t addr, int *status)
+{
+	if (cpu->mem->rpages[addr >> MEM_PAGE_SHIFT])
+		return 1;
+	if (addr >= 0x2000 && addr < 0x4000 && (addr & 7) == 2)
+	{
+		*status = 1;
+		return 1;
+	}
+	return 0;
+}
+
+static uint16_t idle_zp16(mem_t *mem, uint8_t addr)
+{
+	return mem_get(mem, addr) | (mem_get(mem, (uint8_t)(addr + 1)) << 8);
+}
+
+/* walks the loop body from the branch target up to the branch, the index
+ * registers hold the same value on every pass so the addresses are known
+ */
+static int idle_body(cpu_t *cpu, uint16_t pc, uint16_t from, int *status)
+{
+	mem_t *mem = cpu->mem;
+	uint8_t x = cpu->regs.x;
+	uint8_t y = cpu->regs.y;
+	uint8_t writes = 0;
+	uint8_t uses = 0;
+	uint16_t size = from - pc;
+	if (size > IDLE_BODY_SIZE)
+		return 0;
+	while (pc != from)
+	{
+		if (!mem->rpages[pc >> MEM_PAGE_SHIFT]
+		 || !mem->rpages[(uint16_t)(pc + 2) >> MEM_PAGE_SHIFT])
+			return 0;
+		uint8_t instr = idle_instr[mem_get(mem, pc)];
+		uint8_t arg = mem_get(mem, pc + 1);
+		uint16_t abs = arg | (mem_get(mem, pc + 2) << 8);
+		int ok = 1;
+		writes |= instr & (IDLE_WRITE_X | IDLE_WRITE_Y);
+		switch (instr & IDLE_MODE_MASK)
+		{
+			case IDLE_NONE:
+				return 0;
+			case IDLE_IMP:
+				pc += 1;
+				break;
+			case IDLE_IMM:
+			case IDLE_ZP:
+				pc += 2;
+				break;
+			case IDLE_ZP_X:
+				uses |= IDLE_WRITE_X;
+				pc += 2;
+				break;
+			case IDLE_ZP_Y:
+				uses |= IDLE_WRITE_Y;
+				pc += 2;
+				break;
+			case IDLE_ABS:
+				ok = idle_read(cpu, abs, status);
+				pc += 3;
+				break;
+			case IDLE_ABS_X:
+				uses |= IDLE_WRITE_X;
+				ok = idle_read(cpu, abs + x, status);
+				pc += 3;
+				break;
+			case IDLE_ABS_Y:
+				uses |= IDLE_WRITE_Y;
+				ok = idle_read(cpu, abs + y, status);
+				pc += 3;
+				break;
+			case IDLE_IND_X:
+				uses |= IDLE_WRITE_X;
+				ok = idle_read(cpu, idle_zp16(mem, arg + x), status);
+				pc += 2;
+				break;
+			case IDLE_IND_Y:
+				uses |= IDLE_WRITE_Y;
+				ok = idle_read(cpu, idle_zp16(mem, arg) + y, status);
+				pc += 2;
+				break;
+		}
+		if (!ok || (uint16_t)(from - pc) > size)
+			return 0;
+	}
+	return !(writes & uses);
+}
+
+/* called on each taken backward branch or jmp, once two passes on the same
+ * branch end with the same registers and the loop only polls memory or
+ * $2002, every pass will be the same until the next event or the next
+ * $2002 change: the passes up to there are skipped in one go
+ */
+void cpu_idle(cpu_t *cpu, uint16_t from)
+{
+	uint64_t iter = cpu->cycles - cpu->idle_cycles;
+	if (cpu->idle_pc != from
+	 || cpu->idle_regs.a != cpu->regs.a
+	 || cpu->idle_regs.x != cpu->regs.x
+	 || cpu->idle_regs.y != cpu->regs.y
+	 || cpu->idle_regs.s != cpu->regs.s
+	 || cpu->idle_regs.p != cpu->regs.p)
+	{
+		cpu->idle_pc = from;
+		cpu->idle_regs = cpu->regs;
+		cpu->idle_cycles = cpu->cycles;
+		return;
+	}
+	cpu->idle_cycles = cpu->cycles;
+	if (!iter || iter > IDLE_ITER_CYCLES || cpu->nmi || cpu->reset)
+		return;
+	int status = 0;
+	if (!idle_body(cpu, cpu->regs.pc, from, &status))
+		return;
+	uint64_t clock = cpu->cycles * CPU_CLOCK_DIVIDER;
+	uint64_t until = cpu->sched->until;
+	/* the reads of the last pass may predate a change */
+	if (status)
+		until = gpu_status_next(cpu->mem->gpu,
+		                        clock - iter * CPU_CLOCK_DIVIDER, until);
+	/* the current pass still has to end before until */
+	uint64_t n = until > clock ? (until - clock) / (iter * CPU_CLOCK_DIVIDER)
+	                           : 0;
+	if (n <= 1)
+		return;
+	n--;
+	cpu->instr_delay += n * iter;
+	cpu->idle_cycles += n * iter;
+}
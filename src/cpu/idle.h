@@ -0,0 +1,10 @@
+#ifndef CPU_IDLE_H
+#define CPU_IDLE_H
+
+#include <stdint.h>
+
+typedef struct cpu cpu_t;
+
+void cpu_idle(cpu_t *cpu, uint16_t from);
+
+#endif
@@ -1,6 +1,9 @@
 #include "instr.h"
+#include "trace.h"
+#include "idle.h"
 #include "../cpu.h"
 #include "../mem.h"
+#include "../sched.h"
 #include <inttypes.h>
 #include <string.h>
 #include <stdlib.h>
@@ -13,6 +16,21 @@ static const cpu_instr_t name = \
 	.print = print_##name, \
 }
 
+/* backward jumps are where polling loops close */
+#ifdef CPU_IDLE
+#define CPU_IDLE_CHECK(cpu, to, from) \
+do \
+{ \
+	if ((uint16_t)(to) <= (uint16_t)(from)) \
+		cpu_idle(cpu, from); \
+} while (0)
+/* a handler run between two passes would be counted in the pass length */
+#define CPU_IDLE_FORGET(cpu) do { (cpu)->idle_pc = 0; } while (0)
+#else
+#define CPU_IDLE_CHECK(cpu, to, from) do { (void)(from); } while (0)
+#define CPU_IDLE_FORGET(cpu) do { } while (0)
+#endif
+
 static uint16_t ind_x_addr(cpu_t *cpu)
 {
 	uint8_t ind = cpu_fetch8(cpu) + cpu->regs.x;
@@ -20,12 +38,31 @@ static uint16_t ind_x_addr(cpu_t *cpu)
 	     | ((uint16_t)mem_get(cpu->mem, (ind + 1) & 0xFF) << 8);
 }
 
-static uint16_t ind_y_addr(cpu_t *cpu)
+/* indexed reads take one more cycle when the index carries into the high
+ * byte, writes and read-modify-writes always pay for it in their base cycles
+ */
+static uint16_t cross_addr(cpu_t *cpu, uint16_t base, uint8_t index)
+{
+	uint16_t addr = base + index;
+	cpu->instr_delay += (base ^ addr) > 0xFF;
+	return addr;
+}
+
+static uint16_t ind_y_base(cpu_t *cpu)
 {
 	uint8_t ind = cpu_fetch8(cpu);
-	uint16_t addr = ((uint16_t)mem_get(cpu->mem, (ind + 0) & 0xFF) << 0)
-	              | ((uint16_t)mem_get(cpu->mem, (ind + 1) & 0xFF) << 8);
-	return addr + cpu->regs.y;
+	return ((uint16_t)mem_get(cpu->mem, (ind + 0) & 0xFF) << 0)
+	     | ((uint16_t)mem_get(cpu->mem, (ind + 1) & 0xFF) << 8);
+}
+
+static uint16_t ind_y_addr(cpu_t *cpu)
+{
+	return ind_y_base(cpu) + cpu->regs.y;
+}
+
+static uint16_t ind_y_read_addr(cpu_t *cpu)
+{
+	return cross_addr(cpu, ind_y_base(cpu), cpu->regs.y);
 }
 
 static void exec_clc(cpu_t *cpu)
@@ -33,9 +70,9 @@ static void exec_clc(cpu_t *cpu)
 	CPU_SET_FLAG_C(cpu, 0);
 }
 
-static void print_clc(cpu_t *cpu, char *data, size_t size)
+static void print_clc(const uint8_t *args, char *data, size_t size)
 {
-	(void)cpu;
+	(void)args;
 	snprintf(data, size, "clc");
 }
 
@@ -46,9 +83,9 @@ static void exec_sec(cpu_t *cpu)
 	CPU_SET_FLAG_C(cpu, 1);
 }
 
-static void print_sec(cpu_t *cpu, char *data, size_t size)
+static void print_sec(const uint8_t *args, char *data, size_t size)
 {
-	(void)cpu;
+	(void)args;
 	snprintf(data, size, "sec");
 }
 
@@ -59,9 +96,9 @@ static void exec_cli(cpu_t *cpu)
 	CPU_SET_FLAG_I(cpu, 0);
 }
 
-static void print_cli(cpu_t *cpu, char *data, size_t size)
+static void print_cli(const uint8_t *args, char *data, size_t size)
 {
-	(void)cpu;
+	(void)args;
 	snprintf(data, size, "cli");
 }
 
@@ -72,9 +109,9 @@ static void exec_sei(cpu_t *cpu)
 	CPU_SET_FLAG_I(cpu, 1);
 }
 
-static void print_sei(cpu_t *cpu, char *data, size_t size)
+static void print_sei(const uint8_t *args, char *data, size_t size)
 {
-	(void)cpu;
+	(void)args;
 	snprintf(data, size, "sei");
 }
 
@@ -85,9 +122,9 @@ static void exec_clv(cpu_t *cpu)
 	CPU_SET_FLAG_V(cpu, 0);
 }
 
-static void print_clv(cpu_t *cpu, char *data, size_t size)
+static void print_clv(const uint8_t *args, char *data, size_t size)
 {
-	(void)cpu;
+	(void)args;
 	snprintf(data, size, "clv");
 }
 
@@ -98,9 +135,9 @@ static void exec_cld(cpu_t *cpu)
 	CPU_SET_FLAG_D(cpu, 0);
 }
 
-static void print_cld(cpu_t *cpu, char *data, size_t size)
+static void print_cld(const uint8_t *args, char *data, size_t size)
 {
-	(void)cpu;
+	(void)args;
 	snprintf(data, size, "cld");
 }
 
@@ -111,9 +148,9 @@ static void exec_sed(cpu_t *cpu)
 	CPU_SET_FLAG_D(cpu, 1);
 }
 
-static void print_sed(cpu_t *cpu, char *data, size_t size)
+static void print_sed(const uint8_t *args, char *data, size_t size)
 {
-	(void)cpu;
+	(void)args;
 	snprintf(data, size, "sed");
 }
 
@@ -127,9 +164,9 @@ static void exec_ld##r##_imm(cpu_t *cpu) \
 	CPU_SET_FLAG_Z(cpu, !imm); \
 	CPU_SET_FLAG_N(cpu, imm & 0x80); \
 } \
-static void print_ld##r##_imm(cpu_t *cpu, char *data, size_t size) \
+static void print_ld##r##_imm(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t imm = cpu_peek8(cpu); \
+	uint8_t imm = args[0]; \
 	snprintf(data, size, "ld" #r " #$%02" PRIx8, imm); \
 } \
 CPU_INSTR(ld##r##_imm)
@@ -144,9 +181,9 @@ static void exec_st##r##_ind16(cpu_t *cpu) \
 	uint16_t ind = cpu_fetch16(cpu); \
 	mem_set(cpu->mem, ind, cpu->regs.r); \
 } \
-static void print_st##r##_ind16(cpu_t *cpu, char *data, size_t size) \
+static void print_st##r##_ind16(const uint8_t *args, char *data, size_t size) \
 { \
-	uint16_t ind = cpu_peek16(cpu); \
+	uint16_t ind = args[0] | (args[1] << 8); \
 	snprintf(data, size, "st" #r " $%04" PRIx16, ind); \
 } \
 CPU_INSTR(st##r##_ind16)
@@ -165,9 +202,9 @@ static void exec_t##rs##rd(cpu_t *cpu) \
 		CPU_SET_FLAG_N(cpu, cpu->regs.rd & 0x80); \
 	} \
 } \
-static void print_t##rs##rd(cpu_t *cpu, char *data, size_t size) \
+static void print_t##rs##rd(const uint8_t *args, char *data, size_t size) \
 { \
-	(void)cpu; \
+	(void)args; \
 	snprintf(data, size, "t" #rs #rd); \
 } \
 CPU_INSTR(t##rs##rd)
@@ -185,9 +222,9 @@ static void exec_st##r##_ind8(cpu_t *cpu) \
 	uint8_t ind = cpu_fetch8(cpu); \
 	mem_set(cpu->mem, ind, cpu->regs.r); \
 } \
-static void print_st##r##_ind8(cpu_t *cpu, char *data, size_t size) \
+static void print_st##r##_ind8(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t ind = cpu_peek8(cpu); \
+	uint8_t ind = args[0]; \
 	snprintf(data, size, "st" #r " $%02" PRIx8, ind); \
 } \
 CPU_INSTR(st##r##_ind8)
@@ -200,13 +237,13 @@ STR_IND8(y);
 static void exec_ld##rd##_ind16_##rs(cpu_t *cpu) \
 { \
 	uint16_t ind = cpu_fetch16(cpu); \
-	cpu->regs.rd = mem_get(cpu->mem, ind + cpu->regs.rs); \
+	cpu->regs.rd = mem_get(cpu->mem, cross_addr(cpu, ind, cpu->regs.rs)); \
 	CPU_SET_FLAG_Z(cpu, !cpu->regs.rd); \
 	CPU_SET_FLAG_N(cpu, cpu->regs.rd & 0x80); \
 } \
-static void print_ld##rd##_ind16_##rs(cpu_t *cpu, char *data, size_t size) \
+static void print_ld##rd##_ind16_##rs(const uint8_t *args, char *data, size_t size) \
 { \
-	uint16_t ind = cpu_peek16(cpu); \
+	uint16_t ind = args[0] | (args[1] << 8); \
 	snprintf(data, size, "ld" #rd " $%04" PRIx16 ", " #rs, ind); \
 } \
 CPU_INSTR(ld##rd##_ind16_##rs)
@@ -224,9 +261,9 @@ static void exec_ld##r##_ind8(cpu_t *cpu) \
 	CPU_SET_FLAG_Z(cpu, !cpu->regs.r); \
 	CPU_SET_FLAG_N(cpu, cpu->regs.r & 0x80); \
 } \
-static void print_ld##r##_ind8(cpu_t *cpu, char *data, size_t size) \
+static void print_ld##r##_ind8(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t ind = cpu_peek8(cpu); \
+	uint8_t ind = args[0]; \
 	snprintf(data, size, "ld" #r " $%02" PRIx8, ind); \
 } \
 CPU_INSTR(ld##r##_ind8)
@@ -243,9 +280,9 @@ static void exec_ld##r##_ind16(cpu_t *cpu) \
 	CPU_SET_FLAG_Z(cpu, !cpu->regs.r); \
 	CPU_SET_FLAG_N(cpu, cpu->regs.r & 0x80); \
 } \
-static void print_ld##r##_ind16(cpu_t *cpu, char *data, size_t size) \
+static void print_ld##r##_ind16(const uint8_t *args, char *data, size_t size) \
 { \
-	uint16_t ind = cpu_peek16(cpu); \
+	uint16_t ind = args[0] | (args[1] << 8); \
 	snprintf(data, size, "ld" #r " $%04" PRIx16, ind); \
 } \
 CPU_INSTR(ld##r##_ind16)
@@ -262,9 +299,9 @@ static void exec_ld##rd##_ind8_##rs(cpu_t *cpu) \
 	CPU_SET_FLAG_Z(cpu, !cpu->regs.rd); \
 	CPU_SET_FLAG_N(cpu, cpu->regs.rd & 0x80); \
 } \
-static void print_ld##rd##_ind8_##rs(cpu_t *cpu, char *data, size_t size) \
+static void print_ld##rd##_ind8_##rs(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t ind = cpu_peek8(cpu); \
+	uint8_t ind = args[0]; \
 	snprintf(data, size, "ld" #rd " $%02" PRIx8 ", " #rs, ind); \
 } \
 CPU_INSTR(ld##rd##_ind8_##rs)
@@ -278,11 +315,16 @@ static void exec_##name(cpu_t *cpu) \
 { \
 	int8_t dd = cpu_fetch8(cpu); \
 	if (CPU_GET_FLAG(cpu, CPU_FLAG_##flag) == v) \
-		cpu->regs.pc += dd; \
+	{ \
+		uint16_t pc = cpu->regs.pc + dd; \
+		cpu->instr_delay += 1 + ((pc ^ cpu->regs.pc) > 0xFF); \
+		cpu->regs.pc = pc; \
+		CPU_IDLE_CHECK(cpu, pc, pc - dd - 2); \
+	} \
 } \
-static void print_##name(cpu_t *cpu, char *data, size_t size) \
+static void print_##name(const uint8_t *args, char *data, size_t size) \
 { \
-	int8_t dd = cpu_peek8(cpu); \
+	int8_t dd = args[0]; \
 	snprintf(data, size, #name " $%" PRId8, dd); \
 } \
 CPU_INSTR(name)
@@ -301,9 +343,9 @@ static void exec_pha(cpu_t *cpu)
 	mem_set(cpu->mem, 0x100 + cpu->regs.s--, cpu->regs.a);
 }
 
-static void print_pha(cpu_t *cpu, char *data, size_t size)
+static void print_pha(const uint8_t *args, char *data, size_t size)
 {
-	(void)cpu;
+	(void)args;
 	snprintf(data, size, "pha");
 }
 
@@ -314,9 +356,9 @@ static void exec_php(cpu_t *cpu)
 	mem_set(cpu->mem, 0x100 + cpu->regs.s--, 0x30 | cpu->regs.p);
 }
 
-static void print_php(cpu_t *cpu, char *data, size_t size)
+static void print_php(const uint8_t *args, char *data, size_t size)
 {
-	(void)cpu;
+	(void)args;
 	snprintf(data, size, "php");
 }
 
@@ -329,9 +371,9 @@ static void exec_pla(cpu_t *cpu)
 	CPU_SET_FLAG_N(cpu, cpu->regs.a & 0x80);
 }
 
-static void print_pla(cpu_t *cpu, char *data, size_t size)
+static void print_pla(const uint8_t *args, char *data, size_t size)
 {
-	(void)cpu;
+	(void)args;
 	snprintf(data, size, "pla");
 }
 
@@ -342,9 +384,9 @@ static void exec_plp(cpu_t *cpu)
 	cpu->regs.p = mem_get(cpu->mem, 0x100 + ++cpu->regs.s);
 }
 
-static void print_plp(cpu_t *cpu, char *data, size_t size)
+static void print_plp(const uint8_t *args, char *data, size_t size)
 {
-	(void)cpu;
+	(void)args;
 	snprintf(data, size, "plp");
 }
 
@@ -359,9 +401,9 @@ static void exec_jsr(cpu_t *cpu)
 	cpu->regs.pc = imm;
 }
 
-static void print_jsr(cpu_t *cpu, char *data, size_t size)
+static void print_jsr(const uint8_t *args, char *data, size_t size)
 {
-	uint16_t imm = cpu_peek16(cpu);
+	uint16_t imm = args[0] | (args[1] << 8);
 	snprintf(data, size, "jsr $%" PRIx16, imm);
 }
 
@@ -376,9 +418,9 @@ static void exec_rti(cpu_t *cpu)
 	cpu->regs.pc = lo | (hi << 8);
 }
 
-static void print_rti(cpu_t *cpu, char *data, size_t size)
+static void print_rti(const uint8_t *args, char *data, size_t size)
 {
-	(void)cpu;
+	(void)args;
 	snprintf(data, size, "rti");
 }
 
@@ -391,9 +433,9 @@ static void exec_rts(cpu_t *cpu)
 	cpu->regs.pc = (lo | (hi << 8)) + 1;
 }
 
-static void print_rts(cpu_t *cpu, char *data, size_t size)
+static void print_rts(const uint8_t *args, char *data, size_t size)
 {
-	(void)cpu;
+	(void)args;
 	snprintf(data, size, "rts");
 }
 
@@ -402,12 +444,14 @@ CPU_INSTR(rts);
 static void exec_jmp_imm(cpu_t *cpu)
 {
 	uint16_t imm = cpu_fetch16(cpu);
+	uint16_t from = cpu->regs.pc - 3;
 	cpu->regs.pc = imm;
+	CPU_IDLE_CHECK(cpu, imm, from);
 }
 
-static void print_jmp_imm(cpu_t *cpu, char *data, size_t size)
+static void print_jmp_imm(const uint8_t *args, char *data, size_t size)
 {
-	uint16_t imm = cpu_peek16(cpu);
+	uint16_t imm = args[0] | (args[1] << 8);
 	snprintf(data, size, "jmp $%04" PRIx16, imm);
 }
 
@@ -421,9 +465,9 @@ static void exec_jmp_ind(cpu_t *cpu)
 	cpu->regs.pc = lo | (hi << 8);
 }
 
-static void print_jmp_ind(cpu_t *cpu, char *data, size_t size)
+static void print_jmp_ind(const uint8_t *args, char *data, size_t size)
 {
-	uint16_t ind = cpu_peek16(cpu);
+	uint16_t ind = args[0] | (args[1] << 8);
 	snprintf(data, size, "jmp ($%04" PRIx16 ")", ind);
 }
 
@@ -442,9 +486,9 @@ static void exec_brk(cpu_t *cpu)
 	cpu->regs.pc = lo | (hi << 8);
 }
 
-static void print_brk(cpu_t *cpu, char *data, size_t size)
+static void print_brk(const uint8_t *args, char *data, size_t size)
 {
-	(void)cpu;
+	(void)args;
 	snprintf(data, size, "brk");
 }
 
@@ -455,9 +499,9 @@ static void exec_nop(cpu_t *cpu)
 	(void)cpu;
 }
 
-static void print_nop(cpu_t *cpu, char *data, size_t size)
+static void print_nop(const uint8_t *args, char *data, size_t size)
 {
-	(void)cpu;
+	(void)args;
 	snprintf(data, size, "nop");
 }
 
@@ -469,9 +513,9 @@ static void exec_nop_imm(cpu_t *cpu)
 	(void)imm;
 }
 
-static void print_nop_imm(cpu_t *cpu, char *data, size_t size)
+static void print_nop_imm(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t imm = cpu_peek8(cpu);
+	uint8_t imm = args[0];
 	snprintf(data, size, "nop #$%02" PRIx8, imm);
 	(void)imm;
 }
@@ -484,9 +528,9 @@ static void exec_nop_ind8(cpu_t *cpu)
 	(void)ind;
 }
 
-static void print_nop_ind8(cpu_t *cpu, char *data, size_t size)
+static void print_nop_ind8(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t ind = cpu_peek8(cpu);
+	uint8_t ind = args[0];
 	snprintf(data, size, "nop $%02" PRIx8, ind);
 }
 
@@ -498,9 +542,9 @@ static void exec_nop_ind16(cpu_t *cpu)
 	(void)ind;
 }
 
-static void print_nop_ind16(cpu_t *cpu, char *data, size_t size)
+static void print_nop_ind16(const uint8_t *args, char *data, size_t size)
 {
-	uint16_t ind = cpu_peek16(cpu);
+	uint16_t ind = args[0] | (args[1] << 8);
 	snprintf(data, size, "nop $%04" PRIx16, ind);
 }
 
@@ -512,9 +556,9 @@ static void exec_nop_ind8_x(cpu_t *cpu)
 	(void)ind;
 }
 
-static void print_nop_ind8_x(cpu_t *cpu, char *data, size_t size)
+static void print_nop_ind8_x(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t ind = cpu_peek8(cpu);
+	uint8_t ind = args[0];
 	snprintf(data, size, "nop $%02" PRIx8 ", x", ind);
 }
 
@@ -523,12 +567,12 @@ CPU_INSTR(nop_ind8_x);
 static void exec_nop_ind16_x(cpu_t *cpu)
 {
 	uint16_t ind = cpu_fetch16(cpu);
-	(void)ind;
+	cross_addr(cpu, ind, cpu->regs.x);
 }
 
-static void print_nop_ind16_x(cpu_t *cpu, char *data, size_t size)
+static void print_nop_ind16_x(const uint8_t *args, char *data, size_t size)
 {
-	uint16_t ind = cpu_peek16(cpu);
+	uint16_t ind = args[0] | (args[1] << 8);
 	snprintf(data, size, "nop $%04" PRIx16 ", x", ind);
 }
 
@@ -542,9 +586,9 @@ static void exec_lda_ind_x(cpu_t *cpu)
 	CPU_SET_FLAG_N(cpu, cpu->regs.a & 0x80);
 }
 
-static void print_lda_ind_x(cpu_t *cpu, char *data, size_t size)
+static void print_lda_ind_x(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t ind = cpu_peek8(cpu);
+	uint8_t ind = args[0];
 	snprintf(data, size, "lda ($%02" PRIx8 ", x)", ind);
 }
 
@@ -552,15 +596,15 @@ CPU_INSTR(lda_ind_x);
 
 static void exec_lda_ind_y(cpu_t *cpu)
 {
-	uint16_t ind = ind_y_addr(cpu);
+	uint16_t ind = ind_y_read_addr(cpu);
 	cpu->regs.a = mem_get(cpu->mem, ind);
 	CPU_SET_FLAG_Z(cpu, !cpu->regs.a);
 	CPU_SET_FLAG_N(cpu, cpu->regs.a & 0x80);
 }
 
-static void print_lda_ind_y(cpu_t *cpu, char *data, size_t size)
+static void print_lda_ind_y(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t ind = cpu_peek8(cpu);
+	uint8_t ind = args[0];
 	snprintf(data, size, "lda ($%02" PRIx8 "), y", ind);
 }
 
@@ -572,9 +616,9 @@ static void exec_sta_ind16_##r(cpu_t *cpu) \
 	uint16_t ind = cpu_fetch16(cpu); \
 	mem_set(cpu->mem, ind + cpu->regs.r, cpu->regs.a); \
 } \
-static void print_sta_ind16_##r(cpu_t *cpu, char *data, size_t size) \
+static void print_sta_ind16_##r(const uint8_t *args, char *data, size_t size) \
 { \
-	uint16_t ind = cpu_peek16(cpu); \
+	uint16_t ind = args[0] | (args[1] << 8); \
 	snprintf(data, size, "sta $%04" PRIx16 ", " #r, ind); \
 } \
 CPU_INSTR(sta_ind16_##r)
@@ -588,9 +632,9 @@ static void exec_st##rd##_ind8_##rs(cpu_t *cpu) \
 	uint8_t ind = cpu_fetch8(cpu); \
 	mem_set(cpu->mem, (ind + cpu->regs.rs) & 0xFF, cpu->regs.rd); \
 } \
-static void print_st##rd##_ind8_##rs(cpu_t *cpu, char *data, size_t size) \
+static void print_st##rd##_ind8_##rs(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t ind = cpu_peek8(cpu); \
+	uint8_t ind = args[0]; \
 	snprintf(data, size, "st" #rd " $%02" PRIx8 ", " #rs, ind); \
 } \
 CPU_INSTR(st##rd##_ind8_##rs)
@@ -605,9 +649,9 @@ static void exec_sta_ind_x(cpu_t *cpu)
 	mem_set(cpu->mem, ind, cpu->regs.a);
 }
 
-static void print_sta_ind_x(cpu_t *cpu, char *data, size_t size)
+static void print_sta_ind_x(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t ind = cpu_peek8(cpu);
+	uint8_t ind = args[0];
 	snprintf(data, size, "sta ($%02" PRIx8 ", x)", ind);
 }
 
@@ -619,9 +663,9 @@ static void exec_sta_ind_y(cpu_t *cpu)
 	mem_set(cpu->mem, ind, cpu->regs.a);
 }
 
-static void print_sta_ind_y(cpu_t *cpu, char *data, size_t size)
+static void print_sta_ind_y(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t ind = cpu_peek8(cpu);
+	uint8_t ind = args[0];
 	snprintf(data, size, "sta ($%02" PRIx8 "), y", ind);
 }
 
@@ -634,9 +678,9 @@ static void exec_in##r(cpu_t *cpu) \
 	CPU_SET_FLAG_Z(cpu, !cpu->regs.r); \
 	CPU_SET_FLAG_N(cpu, cpu->regs.r & 0x80); \
 } \
-static void print_in##r(cpu_t *cpu, char *data, size_t size) \
+static void print_in##r(const uint8_t *args, char *data, size_t size) \
 { \
-	(void)cpu; \
+	(void)args; \
 	snprintf(data, size, "in" #r); \
 } \
 CPU_INSTR(in##r)
@@ -651,9 +695,9 @@ static void exec_de##r(cpu_t *cpu) \
 	CPU_SET_FLAG_Z(cpu, !cpu->regs.r); \
 	CPU_SET_FLAG_N(cpu, cpu->regs.r & 0x80); \
 } \
-static void print_de##r(cpu_t *cpu, char *data, size_t size) \
+static void print_de##r(const uint8_t *args, char *data, size_t size) \
 { \
-	(void)cpu; \
+	(void)args; \
 	snprintf(data, size, "de" #r); \
 } \
 CPU_INSTR(de##r)
@@ -670,9 +714,9 @@ static void exec_##name##c_ind8(cpu_t *cpu) \
 	CPU_SET_FLAG_Z(cpu, !val); \
 	CPU_SET_FLAG_N(cpu, val & 0x80); \
 } \
-static void print_##name##c_ind8(cpu_t *cpu, char *data, size_t size) \
+static void print_##name##c_ind8(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t ind = cpu_peek8(cpu); \
+	uint8_t ind = args[0]; \
 	snprintf(data, size, #name "c $%02" PRIx8, ind); \
 } \
 CPU_INSTR(name##c_ind8); \
@@ -684,9 +728,9 @@ static void exec_##name##c_ind8_x(cpu_t *cpu) \
 	CPU_SET_FLAG_Z(cpu, !val); \
 	CPU_SET_FLAG_N(cpu, val & 0x80); \
 } \
-static void print_##name##c_ind8_x(cpu_t *cpu, char *data, size_t size) \
+static void print_##name##c_ind8_x(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t ind = cpu_peek8(cpu); \
+	uint8_t ind = args[0]; \
 	snprintf(data, size, #name "c $%02" PRIx8 ", x", ind); \
 } \
 CPU_INSTR(name##c_ind8_x); \
@@ -698,9 +742,9 @@ static void exec_##name##c_ind16(cpu_t *cpu) \
 	CPU_SET_FLAG_Z(cpu, !val); \
 	CPU_SET_FLAG_N(cpu, val & 0x80); \
 } \
-static void print_##name##c_ind16(cpu_t *cpu, char *data, size_t size) \
+static void print_##name##c_ind16(const uint8_t *args, char *data, size_t size) \
 { \
-	uint16_t ind = cpu_peek16(cpu); \
+	uint16_t ind = args[0] | (args[1] << 8); \
 	snprintf(data, size, #name "c $%04" PRIx16, ind); \
 } \
 CPU_INSTR(name##c_ind16); \
@@ -712,9 +756,9 @@ static void exec_##name##c_ind16_x(cpu_t *cpu) \
 	CPU_SET_FLAG_Z(cpu, !val); \
 	CPU_SET_FLAG_N(cpu, val & 0x80); \
 } \
-static void print_##name##c_ind16_x(cpu_t *cpu, char *data, size_t size) \
+static void print_##name##c_ind16_x(const uint8_t *args, char *data, size_t size) \
 { \
-	uint16_t ind = cpu_peek16(cpu); \
+	uint16_t ind = args[0] | (args[1] << 8); \
 	snprintf(data, size, #name "c $%04" PRIx16 ", x", ind); \
 } \
 CPU_INSTR(name##c_ind16_x)
@@ -757,9 +801,9 @@ static void exec_##op##_a(cpu_t *cpu) \
 	CPU_SET_FLAG_Z(cpu, !cpu->regs.a); \
 	CPU_SET_FLAG_N(cpu, cpu->regs.a & 0x80); \
 } \
-static void print_##op##_a(cpu_t *cpu, char *data, size_t size) \
+static void print_##op##_a(const uint8_t *args, char *data, size_t size) \
 { \
-	(void)cpu; \
+	(void)args; \
 	snprintf(data, size, #op " a"); \
 } \
 CPU_INSTR(op##_a); \
@@ -771,9 +815,9 @@ static void exec_##op##_ind8(cpu_t *cpu) \
 	CPU_SET_FLAG_Z(cpu, !v); \
 	CPU_SET_FLAG_N(cpu, v & 0x80); \
 } \
-static void print_##op##_ind8(cpu_t *cpu, char *data, size_t size) \
+static void print_##op##_ind8(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t ind = cpu_peek8(cpu); \
+	uint8_t ind = args[0]; \
 	snprintf(data, size, #op " $%02" PRIx8, ind); \
 } \
 CPU_INSTR(op##_ind8); \
@@ -785,9 +829,9 @@ static void exec_##op##_ind8_x(cpu_t *cpu) \
 	CPU_SET_FLAG_Z(cpu, !v); \
 	CPU_SET_FLAG_N(cpu, v & 0x80); \
 } \
-static void print_##op##_ind8_x(cpu_t *cpu, char *data, size_t size) \
+static void print_##op##_ind8_x(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t ind = cpu_peek8(cpu); \
+	uint8_t ind = args[0]; \
 	snprintf(data, size, #op " $%02" PRIx8 ", x", ind); \
 } \
 CPU_INSTR(op##_ind8_x); \
@@ -799,9 +843,9 @@ static void exec_##op##_ind16(cpu_t *cpu) \
 	CPU_SET_FLAG_Z(cpu, !v); \
 	CPU_SET_FLAG_N(cpu, v & 0x80); \
 } \
-static void print_##op##_ind16(cpu_t *cpu, char *data, size_t size) \
+static void print_##op##_ind16(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t ind = cpu_peek16(cpu); \
+	uint16_t ind = args[0] | (args[1] << 8); \
 	snprintf(data, size, #op " $%04" PRIx16, ind); \
 } \
 CPU_INSTR(op##_ind16); \
@@ -813,9 +857,9 @@ static void exec_##op##_ind16_x(cpu_t *cpu) \
 	CPU_SET_FLAG_Z(cpu, !v); \
 	CPU_SET_FLAG_N(cpu, v & 0x80); \
 } \
-static void print_##op##_ind16_x(cpu_t *cpu, char *data, size_t size) \
+static void print_##op##_ind16_x(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t ind = cpu_peek16(cpu); \
+	uint16_t ind = args[0] | (args[1] << 8); \
 	snprintf(data, size, #op " $%04" PRIx16 ", x", ind); \
 } \
 CPU_INSTR(op##_ind16_x)
@@ -834,9 +878,9 @@ static void exec_##name##_imm(cpu_t *cpu) \
 	CPU_SET_FLAG_Z(cpu, !v); \
 	CPU_SET_FLAG_N(cpu, v & 0x80); \
 } \
-static void print_##name##_imm(cpu_t *cpu, char *data, size_t size) \
+static void print_##name##_imm(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t imm = cpu_peek8(cpu); \
+	uint8_t imm = args[0]; \
 	snprintf(data, size, #name " #$%02" PRIx8, imm); \
 } \
 CPU_INSTR(name##_imm); \
@@ -848,9 +892,9 @@ static void exec_##name##_ind8(cpu_t *cpu) \
 	CPU_SET_FLAG_Z(cpu, !v); \
 	CPU_SET_FLAG_N(cpu, v & 0x80); \
 } \
-static void print_##name##_ind8(cpu_t *cpu, char *data, size_t size) \
+static void print_##name##_ind8(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t ind = cpu_peek8(cpu); \
+	uint8_t ind = args[0]; \
 	snprintf(data, size, #name " $%02" PRIx8, ind); \
 } \
 CPU_INSTR(name##_ind8); \
@@ -862,9 +906,9 @@ static void exec_##name##_ind16(cpu_t *cpu) \
 	CPU_SET_FLAG_Z(cpu, !v); \
 	CPU_SET_FLAG_N(cpu, v & 0x80); \
 } \
-static void print_##name##_ind16(cpu_t *cpu, char *data, size_t size) \
+static void print_##name##_ind16(const uint8_t *args, char *data, size_t size) \
 { \
-	uint16_t ind = cpu_peek16(cpu); \
+	uint16_t ind = args[0] | (args[1] << 8); \
 	snprintf(data, size, #name " $%04" PRIx16, ind); \
 } \
 CPU_INSTR(name##_ind16)
@@ -877,14 +921,14 @@ CPR(cpy, y);
 static void exec_cmp_ind16_##r(cpu_t *cpu) \
 { \
 	uint16_t ind = cpu_fetch16(cpu); \
-	uint8_t v = cpu->regs.a - mem_get(cpu->mem, ind + cpu->regs.r); \
+	uint8_t v = cpu->regs.a - mem_get(cpu->mem, cross_addr(cpu, ind, cpu->regs.r)); \
 	CPU_SET_FLAG_C(cpu, v <= cpu->regs.a); \
 	CPU_SET_FLAG_Z(cpu, !v); \
 	CPU_SET_FLAG_N(cpu, v & 0x80); \
 } \
-static void print_cmp_ind16_##r(cpu_t *cpu, char *data, size_t size) \
+static void print_cmp_ind16_##r(const uint8_t *args, char *data, size_t size) \
 { \
-	uint16_t ind = cpu_peek16(cpu); \
+	uint16_t ind = args[0] | (args[1] << 8); \
 	snprintf(data, size, "cmp $%04" PRIx16, ind); \
 } \
 CPU_INSTR(cmp_ind16_##r)
@@ -901,9 +945,9 @@ static void exec_cmp_ind8_x(cpu_t *cpu)
 	CPU_SET_FLAG_N(cpu, v & 0x80);
 }
 
-static void print_cmp_ind8_x(cpu_t *cpu, char *data, size_t size)
+static void print_cmp_ind8_x(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t ind = cpu_peek8(cpu);
+	uint8_t ind = args[0];
 	snprintf(data, size, "cmp $%02" PRIx8 ", x", ind);
 }
 
@@ -918,9 +962,9 @@ static void exec_cmp_ind_x(cpu_t *cpu)
 	CPU_SET_FLAG_N(cpu, v & 0x80);
 }
 
-static void print_cmp_ind_x(cpu_t *cpu, char *data, size_t size)
+static void print_cmp_ind_x(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t ind = cpu_peek8(cpu);
+	uint8_t ind = args[0];
 	snprintf(data, size, "cmp ($%02" PRIx8 ", x)", ind);
 }
 
@@ -928,16 +972,16 @@ CPU_INSTR(cmp_ind_x);
 
 static void exec_cmp_ind_y(cpu_t *cpu)
 {
-	uint16_t ind = ind_y_addr(cpu);
+	uint16_t ind = ind_y_read_addr(cpu);
 	uint8_t v = cpu->regs.a - mem_get(cpu->mem, ind);
 	CPU_SET_FLAG_C(cpu, v <= cpu->regs.a);
 	CPU_SET_FLAG_Z(cpu, !v);
 	CPU_SET_FLAG_N(cpu, v & 0x80);
 }
 
-static void print_cmp_ind_y(cpu_t *cpu, char *data, size_t size)
+static void print_cmp_ind_y(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t ind = cpu_peek8(cpu);
+	uint8_t ind = args[0];
 	snprintf(data, size, "cmp ($%02" PRIx8 ", x)", ind);
 }
 
@@ -953,9 +997,9 @@ static void exec_bit_ind8(cpu_t *cpu)
 	CPU_SET_FLAG_V(cpu, mem & 0x40);
 }
 
-static void print_bit_ind8(cpu_t *cpu, char *data, size_t size)
+static void print_bit_ind8(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t ind = cpu_peek8(cpu);
+	uint8_t ind = args[0];
 	snprintf(data, size, "bit $%02" PRIx8, ind);
 }
 
@@ -971,9 +1015,9 @@ static void exec_bit_ind16(cpu_t *cpu)
 	CPU_SET_FLAG_V(cpu, mem & 0x40);
 }
 
-static void print_bit_ind16(cpu_t *cpu, char *data, size_t size)
+static void print_bit_ind16(const uint8_t *args, char *data, size_t size)
 {
-	uint16_t ind = cpu_peek16(cpu);
+	uint16_t ind = args[0] | (args[1] << 8);
 	snprintf(data, size, "bit $%04" PRIx16, ind);
 }
 
@@ -1026,9 +1070,9 @@ static void exec_##op##_imm(cpu_t *cpu) \
 	uint8_t imm = cpu_fetch8(cpu); \
 	op(cpu, imm); \
 } \
-static void print_##op##_imm(cpu_t *cpu, char *data, size_t size) \
+static void print_##op##_imm(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t imm = cpu_peek8(cpu); \
+	uint8_t imm = args[0]; \
 	snprintf(data, size, #op " #$%02" PRIx8, imm); \
 } \
 CPU_INSTR(op##_imm); \
@@ -1037,9 +1081,9 @@ static void exec_##op##_ind8(cpu_t *cpu) \
 	uint8_t ind = cpu_fetch8(cpu); \
 	op(cpu, mem_get(cpu->mem, ind)); \
 } \
-static void print_##op##_ind8(cpu_t *cpu, char *data, size_t size) \
+static void print_##op##_ind8(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t ind = cpu_peek8(cpu); \
+	uint8_t ind = args[0]; \
 	snprintf(data, size, #op " $%02" PRIx8, ind); \
 } \
 CPU_INSTR(op##_ind8); \
@@ -1048,9 +1092,9 @@ static void exec_##op##_ind8_x(cpu_t *cpu) \
 	uint8_t ind = cpu_fetch8(cpu); \
 	op(cpu, mem_get(cpu->mem, (ind + cpu->regs.x) & 0xFF)); \
 } \
-static void print_##op##_ind8_x(cpu_t *cpu, char *data, size_t size) \
+static void print_##op##_ind8_x(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t ind = cpu_peek8(cpu); \
+	uint8_t ind = args[0]; \
 	snprintf(data, size, #op " $%02" PRIx8 ", x", ind); \
 } \
 CPU_INSTR(op##_ind8_x); \
@@ -1059,31 +1103,31 @@ static void exec_##op##_ind16(cpu_t *cpu) \
 	uint16_t ind = cpu_fetch16(cpu); \
 	op(cpu, mem_get(cpu->mem, ind)); \
 } \
-static void print_##op##_ind16(cpu_t *cpu, char *data, size_t size) \
+static void print_##op##_ind16(const uint8_t *args, char *data, size_t size) \
 { \
-	uint16_t ind = cpu_peek16(cpu); \
+	uint16_t ind = args[0] | (args[1] << 8); \
 	snprintf(data, size, #op " $%04" PRIx16, ind); \
 } \
 CPU_INSTR(op##_ind16); \
 static void exec_##op##_ind16_x(cpu_t *cpu) \
 { \
 	uint16_t ind = cpu_fetch16(cpu); \
-	op(cpu, mem_get(cpu->mem, ind + cpu->regs.x)); \
+	op(cpu, mem_get(cpu->mem, cross_addr(cpu, ind, cpu->regs.x))); \
 } \
-static void print_##op##_ind16_x(cpu_t *cpu, char *data, size_t size) \
+static void print_##op##_ind16_x(const uint8_t *args, char *data, size_t size) \
 { \
-	uint16_t ind = cpu_peek16(cpu); \
+	uint16_t ind = args[0] | (args[1] << 8); \
 	snprintf(data, size, #op " $%04" PRIx16 ", x", ind); \
 } \
 CPU_INSTR(op##_ind16_x); \
 static void exec_##op##_ind16_y(cpu_t *cpu) \
 { \
 	uint16_t ind = cpu_fetch16(cpu); \
-	op(cpu, mem_get(cpu->mem, ind + cpu->regs.y)); \
+	op(cpu, mem_get(cpu->mem, cross_addr(cpu, ind, cpu->regs.y))); \
 } \
-static void print_##op##_ind16_y(cpu_t *cpu, char *data, size_t size) \
+static void print_##op##_ind16_y(const uint8_t *args, char *data, size_t size) \
 { \
-	uint16_t ind = cpu_peek16(cpu); \
+	uint16_t ind = args[0] | (args[1] << 8); \
 	snprintf(data, size, #op " $%04" PRIx16 ", y", ind); \
 } \
 CPU_INSTR(op##_ind16_y); \
@@ -1092,20 +1136,20 @@ static void exec_##op##_ind_x(cpu_t *cpu) \
 	uint16_t ind = ind_x_addr(cpu); \
 	op(cpu, mem_get(cpu->mem, ind)); \
 } \
-static void print_##op##_ind_x(cpu_t *cpu, char *data, size_t size) \
+static void print_##op##_ind_x(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t ind = cpu_peek8(cpu); \
+	uint8_t ind = args[0]; \
 	snprintf(data, size, #op " ($%02" PRIx8 ", x)", ind); \
 } \
 CPU_INSTR(op##_ind_x); \
 static void exec_##op##_ind_y(cpu_t *cpu) \
 { \
-	uint16_t ind = ind_y_addr(cpu); \
+	uint16_t ind = ind_y_read_addr(cpu); \
 	op(cpu, mem_get(cpu->mem, ind)); \
 } \
-static void print_##op##_ind_y(cpu_t *cpu, char *data, size_t size) \
+static void print_##op##_ind_y(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t ind = cpu_peek8(cpu); \
+	uint8_t ind = args[0]; \
 	snprintf(data, size, #op " ($%02" PRIx8 "), y", ind); \
 } \
 CPU_INSTR(op##_ind_y)
@@ -1124,9 +1168,9 @@ static void exec_kil(cpu_t *cpu)
 	abort();
 }
 
-static void print_kil(cpu_t *cpu, char *data, size_t size)
+static void print_kil(const uint8_t *args, char *data, size_t size)
 {
-	(void)cpu;
+	(void)args;
 	snprintf(data, size, "kil");
 }
 
@@ -1138,9 +1182,9 @@ static void exec_sax_ind8(cpu_t *cpu)
 	mem_set(cpu->mem, ind, cpu->regs.a & cpu->regs.x);
 }
 
-static void print_sax_ind8(cpu_t *cpu, char *data, size_t size)
+static void print_sax_ind8(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t ind = cpu_peek8(cpu);
+	uint8_t ind = args[0];
 	snprintf(data, size, "sax $%02" PRIx8, ind);
 }
 
@@ -1152,9 +1196,9 @@ static void exec_sax_ind8_y(cpu_t *cpu)
 	mem_set(cpu->mem, (ind + cpu->regs.y) & 0xFF, cpu->regs.a & cpu->regs.x);
 }
 
-static void print_sax_ind8_y(cpu_t *cpu, char *data, size_t size)
+static void print_sax_ind8_y(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t ind = cpu_peek8(cpu);
+	uint8_t ind = args[0];
 	snprintf(data, size, "sax $%02" PRIx8 ", y", ind);
 }
 
@@ -1166,9 +1210,9 @@ static void exec_sax_ind16(cpu_t *cpu)
 	mem_set(cpu->mem, ind, cpu->regs.a & cpu->regs.x);
 }
 
-static void print_sax_ind16(cpu_t *cpu, char *data, size_t size)
+static void print_sax_ind16(const uint8_t *args, char *data, size_t size)
 {
-	uint16_t ind = cpu_peek16(cpu);
+	uint16_t ind = args[0] | (args[1] << 8);
 	snprintf(data, size, "sax $%04" PRIx16, ind);
 }
 
@@ -1180,9 +1224,9 @@ static void exec_sax_ind_x(cpu_t *cpu)
 	mem_set(cpu->mem, ind, cpu->regs.a & cpu->regs.x);
 }
 
-static void print_sax_ind_x(cpu_t *cpu, char *data, size_t size)
+static void print_sax_ind_x(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t ind = cpu_peek8(cpu);
+	uint8_t ind = args[0];
 	snprintf(data, size, "sax ($%02" PRIx8 ", x)", ind);
 }
 
@@ -1197,9 +1241,9 @@ static void exec_lax_imm(cpu_t *cpu)
 	CPU_SET_FLAG_N(cpu, cpu->regs.x & 0x80);
 }
 
-static void print_lax_imm(cpu_t *cpu, char *data, size_t size)
+static void print_lax_imm(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t imm = cpu_peek8(cpu);
+	uint8_t imm = args[0];
 	snprintf(data, size, "lax #$%02" PRIx8, imm);
 }
 
@@ -1214,9 +1258,9 @@ static void exec_lax_ind8(cpu_t *cpu)
 	CPU_SET_FLAG_N(cpu, cpu->regs.x & 0x80);
 }
 
-static void print_lax_ind8(cpu_t *cpu, char *data, size_t size)
+static void print_lax_ind8(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t ind = cpu_peek8(cpu);
+	uint8_t ind = args[0];
 	snprintf(data, size, "lax $%02" PRIx8, ind);
 }
 
@@ -1231,9 +1275,9 @@ static void exec_lax_ind8_y(cpu_t *cpu)
 	CPU_SET_FLAG_N(cpu, cpu->regs.x & 0x80);
 }
 
-static void print_lax_ind8_y(cpu_t *cpu, char *data, size_t size)
+static void print_lax_ind8_y(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t ind = cpu_peek8(cpu);
+	uint8_t ind = args[0];
 	snprintf(data, size, "lax $%02" PRIx8 ", y", ind);
 }
 
@@ -1248,9 +1292,9 @@ static void exec_lax_ind16(cpu_t *cpu)
 	CPU_SET_FLAG_N(cpu, cpu->regs.x & 0x80);
 }
 
-static void print_lax_ind16(cpu_t *cpu, char *data, size_t size)
+static void print_lax_ind16(const uint8_t *args, char *data, size_t size)
 {
-	uint16_t ind = cpu_peek16(cpu);
+	uint16_t ind = args[0] | (args[1] << 8);
 	snprintf(data, size, "lax $%04" PRIx16, ind);
 }
 
@@ -1259,15 +1303,15 @@ CPU_INSTR(lax_ind16);
 static void exec_lax_ind16_y(cpu_t *cpu)
 {
 	uint16_t ind = cpu_fetch16(cpu);
-	cpu->regs.a = mem_get(cpu->mem, ind + cpu->regs.y);
+	cpu->regs.a = mem_get(cpu->mem, cross_addr(cpu, ind, cpu->regs.y));
 	cpu->regs.x = cpu->regs.a;
 	CPU_SET_FLAG_Z(cpu, !cpu->regs.x);
 	CPU_SET_FLAG_N(cpu, cpu->regs.x & 0x80);
 }
 
-static void print_lax_ind16_y(cpu_t *cpu, char *data, size_t size)
+static void print_lax_ind16_y(const uint8_t *args, char *data, size_t size)
 {
-	uint16_t ind = cpu_peek16(cpu);
+	uint16_t ind = args[0] | (args[1] << 8);
 	snprintf(data, size, "lax $%04" PRIx16 ", y", ind);
 }
 
@@ -1282,9 +1326,9 @@ static void exec_lax_ind_x(cpu_t *cpu)
 	CPU_SET_FLAG_N(cpu, cpu->regs.x & 0x80);
 }
 
-static void print_lax_ind_x(cpu_t *cpu, char *data, size_t size)
+static void print_lax_ind_x(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t ind = cpu_peek8(cpu);
+	uint8_t ind = args[0];
 	snprintf(data, size, "lax ($%02" PRIx8 ", x)", ind);
 }
 
@@ -1292,16 +1336,16 @@ CPU_INSTR(lax_ind_x);
 
 static void exec_lax_ind_y(cpu_t *cpu)
 {
-	uint16_t ind = ind_y_addr(cpu);
+	uint16_t ind = ind_y_read_addr(cpu);
 	cpu->regs.a = mem_get(cpu->mem, ind);
 	cpu->regs.x = cpu->regs.a;
 	CPU_SET_FLAG_Z(cpu, !cpu->regs.x);
 	CPU_SET_FLAG_N(cpu, cpu->regs.x & 0x80);
 }
 
-static void print_lax_ind_y(cpu_t *cpu, char *data, size_t size)
+static void print_lax_ind_y(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t ind = cpu_peek8(cpu);
+	uint8_t ind = args[0];
 	snprintf(data, size, "lax ($%02" PRIx8 "), y", ind);
 }
 
@@ -1318,9 +1362,9 @@ static void exec_axs_imm(cpu_t *cpu)
 	cpu->regs.x = v;
 }
 
-static void print_axs_imm(cpu_t *cpu, char *data, size_t size)
+static void print_axs_imm(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t imm = cpu_peek8(cpu);
+	uint8_t imm = args[0];
 	snprintf(data, size, "axs #$%02" PRIx8, imm);
 }
 
@@ -1377,9 +1421,9 @@ static void exec_##name##_ind8(cpu_t *cpu) \
 	uint8_t ind = cpu_fetch8(cpu); \
 	mem_set(cpu->mem, ind, name(cpu, mem_get(cpu->mem, ind))); \
 } \
-static void print_##name##_ind8(cpu_t *cpu, char *data, size_t size) \
+static void print_##name##_ind8(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t ind = cpu_peek8(cpu); \
+	uint8_t ind = args[0]; \
 	snprintf(data, size, #name " $%02" PRIx8, ind); \
 } \
 CPU_INSTR(name##_ind8); \
@@ -1389,9 +1433,9 @@ static void exec_##name##_ind8_x(cpu_t *cpu) \
 	mem_set(cpu->mem, (ind + cpu->regs.x) & 0xFF, \
 	        name(cpu, mem_get(cpu->mem, (ind + cpu->regs.x) & 0xFF))); \
 } \
-static void print_##name##_ind8_x(cpu_t *cpu, char *data, size_t size) \
+static void print_##name##_ind8_x(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t ind = cpu_peek8(cpu); \
+	uint8_t ind = args[0]; \
 	snprintf(data, size, #name " $%02" PRIx8 ", x", ind); \
 } \
 CPU_INSTR(name##_ind8_x); \
@@ -1400,9 +1444,9 @@ static void exec_##name##_ind16(cpu_t *cpu) \
 	uint16_t ind = cpu_fetch16(cpu); \
 	mem_set(cpu->mem, ind, name(cpu, mem_get(cpu->mem, ind))); \
 } \
-static void print_##name##_ind16(cpu_t *cpu, char *data, size_t size) \
+static void print_##name##_ind16(const uint8_t *args, char *data, size_t size) \
 { \
-	uint16_t ind = cpu_peek16(cpu); \
+	uint16_t ind = args[0] | (args[1] << 8); \
 	snprintf(data, size, #name " $%04" PRIx16, ind); \
 } \
 CPU_INSTR(name##_ind16); \
@@ -1412,9 +1456,9 @@ static void exec_##name##_ind16_x(cpu_t *cpu) \
 	mem_set(cpu->mem, ind + cpu->regs.x, \
 	        name(cpu, mem_get(cpu->mem, ind + cpu->regs.x))); \
 } \
-static void print_##name##_ind16_x(cpu_t *cpu, char *data, size_t size) \
+static void print_##name##_ind16_x(const uint8_t *args, char *data, size_t size) \
 { \
-	uint16_t ind = cpu_peek16(cpu); \
+	uint16_t ind = args[0] | (args[1] << 8); \
 	snprintf(data, size, #name " $%04" PRIx16 ", x", ind); \
 } \
 CPU_INSTR(name##_ind16_x); \
@@ -1423,9 +1467,9 @@ static void exec_##name##_ind16_y(cpu_t *cpu) \
 	uint16_t ind = cpu_fetch16(cpu); \
 	mem_set(cpu->mem, ind + cpu->regs.y, name(cpu, mem_get(cpu->mem, ind + cpu->regs.y))); \
 } \
-static void print_##name##_ind16_y(cpu_t *cpu, char *data, size_t size) \
+static void print_##name##_ind16_y(const uint8_t *args, char *data, size_t size) \
 { \
-	uint16_t ind = cpu_peek16(cpu); \
+	uint16_t ind = args[0] | (args[1] << 8); \
 	snprintf(data, size, #name " $%04" PRIx16 ", y", ind); \
 } \
 CPU_INSTR(name##_ind16_y); \
@@ -1434,9 +1478,9 @@ static void exec_##name##_ind_x(cpu_t *cpu) \
 	uint16_t ind = ind_x_addr(cpu); \
 	mem_set(cpu->mem, ind, name(cpu, mem_get(cpu->mem, ind))); \
 } \
-static void print_##name##_ind_x(cpu_t *cpu, char *data, size_t size) \
+static void print_##name##_ind_x(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t ind = cpu_peek8(cpu); \
+	uint8_t ind = args[0]; \
 	snprintf(data, size, #name " ($%02" PRIx8 ", x)", ind); \
 } \
 CPU_INSTR(name##_ind_x); \
@@ -1445,9 +1489,9 @@ static void exec_##name##_ind_y(cpu_t *cpu) \
 	uint16_t ind = ind_y_addr(cpu); \
 	mem_set(cpu->mem, ind, name(cpu, mem_get(cpu->mem, ind))); \
 } \
-static void print_##name##_ind_y(cpu_t *cpu, char *data, size_t size) \
+static void print_##name##_ind_y(const uint8_t *args, char *data, size_t size) \
 { \
-	uint8_t ind = cpu_peek8(cpu); \
+	uint8_t ind = args[0]; \
 	snprintf(data, size, #name " ($%02" PRIx8 "), y", ind); \
 } \
 CPU_INSTR(name##_ind_y)
@@ -1466,10 +1510,10 @@ static void exec_anc_imm(cpu_t *cpu)
 	CPU_SET_FLAG_C(cpu, cpu->regs.a & 0x80);
 }
 
-static void print_anc_imm(cpu_t *cpu, char *data, size_t size)
+static void print_anc_imm(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t imm = cpu_peek8(cpu);
-	printf(data, size, "anc #$%02" PRIx8, imm);
+	uint8_t imm = args[0];
+	snprintf(data, size, "anc #$%02" PRIx8, imm);
 }
 
 CPU_INSTR(anc_imm);
@@ -1482,9 +1526,9 @@ static void exec_alr_imm(cpu_t *cpu)
 	CPU_SET_FLAG_Z(cpu, !cpu->regs.a);
 }
 
-static void print_alr_imm(cpu_t *cpu, char *data, size_t size)
+static void print_alr_imm(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t imm = cpu_peek8(cpu);
+	uint8_t imm = args[0];
 	snprintf(data, size, "alr #$%02" PRIx8, imm);
 }
 
@@ -1499,9 +1543,9 @@ static void exec_arr_imm(cpu_t *cpu)
 	cpu->regs.a = ror(cpu, cpu->regs.a);
 }
 
-static void print_arr_imm(cpu_t *cpu, char *data, size_t size)
+static void print_arr_imm(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t imm = cpu_peek8(cpu);
+	uint8_t imm = args[0];
 	snprintf(data, size, "arr #$%02" PRIx8, imm);
 }
 
@@ -1514,9 +1558,9 @@ static void exec_xaa_imm(cpu_t *cpu)
 	and(cpu, imm);
 }
 
-static void print_xaa_imm(cpu_t *cpu, char *data, size_t size)
+static void print_xaa_imm(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t imm = cpu_peek8(cpu);
+	uint8_t imm = args[0];
 	snprintf(data, size, "xaa #$%02" PRIx8, imm);
 }
 
@@ -1525,14 +1569,14 @@ CPU_INSTR(xaa_imm);
 static void exec_las_ind16_y(cpu_t *cpu)
 {
 	uint16_t ind = cpu_fetch16(cpu);
-	cpu->regs.s = cpu->regs.s & mem_get(cpu->mem, ind + cpu->regs.y);
+	cpu->regs.s = cpu->regs.s & mem_get(cpu->mem, cross_addr(cpu, ind, cpu->regs.y));
 	cpu->regs.a = cpu->regs.s;
 	cpu->regs.x = cpu->regs.s;
 }
 
-static void print_las_ind16_y(cpu_t *cpu, char *data, size_t size)
+static void print_las_ind16_y(const uint8_t *args, char *data, size_t size)
 {
-	uint16_t ind = cpu_peek16(cpu);
+	uint16_t ind = args[0] | (args[1] << 8);
 	snprintf(data, size, "las $%04" PRIx16 ", y", ind);
 }
 
@@ -1544,9 +1588,9 @@ static void exec_shy_ind16_x(cpu_t *cpu)
 	mem_set(cpu->mem, addr, cpu->regs.y & ((addr >> 8) + 1));
 }
 
-static void print_shy_ind16_x(cpu_t *cpu, char *data, size_t size)
+static void print_shy_ind16_x(const uint8_t *args, char *data, size_t size)
 {
-	uint16_t ind = cpu_peek16(cpu);
+	uint16_t ind = args[0] | (args[1] << 8);
 	snprintf(data, size, "shy $%04" PRIx16 ", x", ind);
 }
 
@@ -1558,9 +1602,9 @@ static void exec_shx_ind16_y(cpu_t *cpu)
 	mem_set(cpu->mem, addr, cpu->regs.x & ((addr >> 8) + 1));
 }
 
-static void print_shx_ind16_y(cpu_t *cpu, char *data, size_t size)
+static void print_shx_ind16_y(const uint8_t *args, char *data, size_t size)
 {
-	uint16_t ind = cpu_peek16(cpu);
+	uint16_t ind = args[0] | (args[1] << 8);
 	snprintf(data, size, "shx $%04" PRIx16 ", y", ind);
 }
 
@@ -1572,9 +1616,9 @@ static void exec_ahx_ind_y(cpu_t *cpu)
 	mem_set(cpu->mem, addr, cpu->regs.a & cpu->regs.x & ((addr >> 8) + 1));
 }
 
-static void print_ahx_ind_y(cpu_t *cpu, char *data, size_t size)
+static void print_ahx_ind_y(const uint8_t *args, char *data, size_t size)
 {
-	uint8_t ind = cpu_peek8(cpu);
+	uint8_t ind = args[0];
 	snprintf(data, size, "ahx ($%02" PRIx8 "), y", ind);
 }
 
@@ -1586,9 +1630,9 @@ static void exec_ahx_ind16_y(cpu_t *cpu)
 	mem_set(cpu->mem, addr, cpu->regs.a & cpu->regs.x & ((addr + 1) >> 8));
 }
 
-static void print_ahx_ind16_y(cpu_t *cpu, char *data, size_t size)
+static void print_ahx_ind16_y(const uint8_t *args, char *data, size_t size)
 {
-	uint16_t ind = cpu_peek16(cpu);
+	uint16_t ind = args[0] | (args[1] << 8);
 	snprintf(data, size, "ahx $%04" PRIx16 ", y", ind);
 }
 
@@ -1597,11 +1641,13 @@ CPU_INSTR(ahx_ind16_y);
 static void exec_tas_ind16_y(cpu_t *cpu)
 {
 	/*XXX*/
+	uint16_t ind = cpu_fetch16(cpu);
+	(void)ind;
 }
 
-static void print_tas_ind16_y(cpu_t *cpu, char *data, size_t size)
+static void print_tas_ind16_y(const uint8_t *args, char *data, size_t size)
 {
-	uint16_t ind = cpu_peek16(cpu);
+	uint16_t ind = args[0] | (args[1] << 8);
 	snprintf(data, size, "tas $%04" PRIx16 ", y", ind);
 }
 
@@ -1609,8 +1655,9 @@ CPU_INSTR(tas_ind16_y);
 
 static void exec_irq(cpu_t *cpu)
 {
+	CPU_IDLE_FORGET(cpu);
 	CPU_SET_FLAG_B(cpu, 0);
-	uint16_t pc = cpu->regs.pc - 1;
+	uint16_t pc = cpu->regs.pc;
 	mem_set(cpu->mem, 0x100 + cpu->regs.s--, pc >> 8);
 	mem_set(cpu->mem, 0x100 + cpu->regs.s--, pc >> 0);
 	mem_set(cpu->mem, 0x100 + cpu->regs.s--, cpu->regs.p | 0x20);
@@ -1620,9 +1667,9 @@ static void exec_irq(cpu_t *cpu)
 	cpu->regs.pc = lo | (hi << 8);
 }
 
-static void print_irq(cpu_t *cpu, char *data, size_t size)
+static void print_irq(const uint8_t *args, char *data, size_t size)
 {
-	(void)cpu;
+	(void)args;
 	snprintf(data, size, "irq");
 }
 
@@ -1634,6 +1681,7 @@ const cpu_instr_t instr_irq =
 
 static void exec_nmi(cpu_t *cpu)
 {
+	CPU_IDLE_FORGET(cpu);
 	CPU_SET_FLAG_B(cpu, 0);
 	uint16_t pc = cpu->regs.pc;
 	mem_set(cpu->mem, 0x100 + cpu->regs.s--, pc >> 8);
@@ -1645,9 +1693,9 @@ static void exec_nmi(cpu_t *cpu)
 	cpu->regs.pc = lo | (hi << 8);
 }
 
-static void print_nmi(cpu_t *cpu, char *data, size_t size)
+static void print_nmi(const uint8_t *args, char *data, size_t size)
 {
-	(void)cpu;
+	(void)args;
 	snprintf(data, size, "nmi");
 }
 
@@ -1659,6 +1707,7 @@ const cpu_instr_t instr_nmi =
 
 static void exec_reset(cpu_t *cpu)
 {
+	CPU_IDLE_FORGET(cpu);
 	CPU_SET_FLAG_B(cpu, 1);
 	cpu->regs.s -= 3;
 	CPU_SET_FLAG_I(cpu, 1);
@@ -1667,9 +1716,9 @@ static void exec_reset(cpu_t *cpu)
 	cpu->regs.pc = lo | (hi << 8);
 }
 
-static void print_reset(cpu_t *cpu, char *data, size_t size)
+static void print_reset(const uint8_t *args, char *data, size_t size)
 {
-	(void)cpu;
+	(void)args;
 	snprintf(data, size, "reset");
 }
 
@@ -1679,70 +1728,194 @@ const cpu_instr_t instr_reset =
 	.print = print_reset,
 };
 
+#define CPU_OPCODES(X) \
+	X(0x00, brk) X(0x01, ora_ind_x) X(0x02, kil) X(0x03, slo_ind_x) \
+	X(0x04, nop_ind8) X(0x05, ora_ind8) X(0x06, asl_ind8) X(0x07, slo_ind8) \
+	X(0x08, php) X(0x09, ora_imm) X(0x0A, asl_a) X(0x0B, anc_imm) \
+	X(0x0C, nop_ind16) X(0x0D, ora_ind16) X(0x0E, asl_ind16) X(0x0F, slo_ind16) \
+	X(0x10, bpl) X(0x11, ora_ind_y) X(0x12, kil) X(0x13, slo_ind_y) \
+	X(0x14, nop_ind8_x) X(0x15, ora_ind8_x) X(0x16, asl_ind8_x) X(0x17, slo_ind8_x) \
+	X(0x18, clc) X(0x19, ora_ind16_y) X(0x1A, nop) X(0x1B, slo_ind16_y) \
+	X(0x1C, nop_ind16_x) X(0x1D, ora_ind16_x) X(0x1E, asl_ind16_x) X(0x1F, slo_ind16_x) \
+	X(0x20, jsr) X(0x21, and_ind_x) X(0x22, kil) X(0x23, rla_ind_x) \
+	X(0x24, bit_ind8) X(0x25, and_ind8) X(0x26, rol_ind8) X(0x27, rla_ind8) \
+	X(0x28, plp) X(0x29, and_imm) X(0x2A, rol_a) X(0x2B, anc_imm) \
+	X(0x2C, bit_ind16) X(0x2D, and_ind16) X(0x2E, rol_ind16) X(0x2F, rla_ind16) \
+	X(0x30, bmi) X(0x31, and_ind_y) X(0x32, kil) X(0x33, rla_ind_y) \
+	X(0x34, nop_ind8_x) X(0x35, and_ind8_x) X(0x36, rol_ind8_x) X(0x37, rla_ind8_x) \
+	X(0x38, sec) X(0x39, and_ind16_y) X(0x3A, nop) X(0x3B, rla_ind16_y) \
+	X(0x3C, nop_ind16_x) X(0x3D, and_ind16_x) X(0x3E, rol_ind16_x) X(0x3F, rla_ind16_x) \
+	X(0x40, rti) X(0x41, eor_ind_x) X(0x42, kil) X(0x43, sre_ind_x) \
+	X(0x44, nop_ind8) X(0x45, eor_ind8) X(0x46, lsr_ind8) X(0x47, sre_ind8) \
+	X(0x48, pha) X(0x49, eor_imm) X(0x4A, lsr_a) X(0x4B, alr_imm) \
+	X(0x4C, jmp_imm) X(0x4D, eor_ind16) X(0x4E, lsr_ind16) X(0x4F, sre_ind16) \
+	X(0x50, bvc) X(0x51, eor_ind_y) X(0x52, kil) X(0x53, sre_ind_y) \
+	X(0x54, nop_ind8_x) X(0x55, eor_ind8_x) X(0x56, lsr_ind8_x) X(0x57, sre_ind8_x) \
+	X(0x58, cli) X(0x59, eor_ind16_y) X(0x5A, nop) X(0x5B, sre_ind16_y) \
+	X(0x5C, nop_ind16_x) X(0x5D, eor_ind16_x) X(0x5E, lsr_ind16_x) X(0x5F, sre_ind16_x) \
+	X(0x60, rts) X(0x61, adc_ind_x) X(0x62, kil) X(0x63, rra_ind_x) \
+	X(0x64, nop_ind8) X(0x65, adc_ind8) X(0x66, ror_ind8) X(0x67, rra_ind8) \
+	X(0x68, pla) X(0x69, adc_imm) X(0x6A, ror_a) X(0x6B, arr_imm) \
+	X(0x6C, jmp_ind) X(0x6D, adc_ind16) X(0x6E, ror_ind16) X(0x6F, rra_ind16) \
+	X(0x70, bvs) X(0x71, adc_ind_y) X(0x72, kil) X(0x73, rra_ind_y) \
+	X(0x74, nop_ind8_x) X(0x75, adc_ind8_x) X(0x76, ror_ind8_x) X(0x77, rra_ind8_x) \
+	X(0x78, sei) X(0x79, adc_ind16_y) X(0x7A, nop) X(0x7B, rra_ind16_y) \
+	X(0x7C, nop_ind16_x) X(0x7D, adc_ind16_x) X(0x7E, ror_ind16_x) X(0x7F, rra_ind16_x) \
+	X(0x80, nop_imm) X(0x81, sta_ind_x) X(0x82, nop_imm) X(0x83, sax_ind_x) \
+	X(0x84, sty_ind8) X(0x85, sta_ind8) X(0x86, stx_ind8) X(0x87, sax_ind8) \
+	X(0x88, dey) X(0x89, nop_imm) X(0x8A, txa) X(0x8B, xaa_imm) \
+	X(0x8C, sty_ind16) X(0x8D, sta_ind16) X(0x8E, stx_ind16) X(0x8F, sax_ind16) \
+	X(0x90, bcc) X(0x91, sta_ind_y) X(0x92, kil) X(0x93, ahx_ind_y) \
+	X(0x94, sty_ind8_x) X(0x95, sta_ind8_x) X(0x96, stx_ind8_y) X(0x97, sax_ind8_y) \
+	X(0x98, tya) X(0x99, sta_ind16_y) X(0x9A, txs) X(0x9B, tas_ind16_y) \
+	X(0x9C, shy_ind16_x) X(0x9D, sta_ind16_x) X(0x9E, shx_ind16_y) X(0x9F, ahx_ind16_y) \
+	X(0xA0, ldy_imm) X(0xA1, lda_ind_x) X(0xA2, ldx_imm) X(0xA3, lax_ind_x) \
+	X(0xA4, ldy_ind8) X(0xA5, lda_ind8) X(0xA6, ldx_ind8) X(0xA7, lax_ind8) \
+	X(0xA8, tay) X(0xA9, lda_imm) X(0xAA, tax) X(0xAB, lax_imm) \
+	X(0xAC, ldy_ind16) X(0xAD, lda_ind16) X(0xAE, ldx_ind16) X(0xAF, lax_ind16) \
+	X(0xB0, bcs) X(0xB1, lda_ind_y) X(0xB2, kil) X(0xB3, lax_ind_y) \
+	X(0xB4, ldy_ind8_x) X(0xB5, lda_ind8_x) X(0xB6, ldx_ind8_y) X(0xB7, lax_ind8_y) \
+	X(0xB8, clv) X(0xB9, lda_ind16_y) X(0xBA, tsx) X(0xBB, las_ind16_y) \
+	X(0xBC, ldy_ind16_x) X(0xBD, lda_ind16_x) X(0xBE, ldx_ind16_y) X(0xBF, lax_ind16_y) \
+	X(0xC0, cpy_imm) X(0xC1, cmp_ind_x) X(0xC2, nop_imm) X(0xC3, dcp_ind_x) \
+	X(0xC4, cpy_ind8) X(0xC5, cmp_ind8) X(0xC6, dec_ind8) X(0xC7, dcp_ind8) \
+	X(0xC8, iny) X(0xC9, cmp_imm) X(0xCA, dex) X(0xCB, axs_imm) \
+	X(0xCC, cpy_ind16) X(0xCD, cmp_ind16) X(0xCE, dec_ind16) X(0xCF, dcp_ind16) \
+	X(0xD0, bne) X(0xD1, cmp_ind_y) X(0xD2, kil) X(0xD3, dcp_ind_y) \
+	X(0xD4, nop_ind8_x) X(0xD5, cmp_ind8_x) X(0xD6, dec_ind8_x) X(0xD7, dcp_ind8_x) \
+	X(0xD8, cld) X(0xD9, cmp_ind16_y) X(0xDA, nop) X(0xDB, dcp_ind16_y) \
+	X(0xDC, nop_ind16_x) X(0xDD, cmp_ind16_x) X(0xDE, dec_ind16_x) X(0xDF, dcp_ind16_x) \
+	X(0xE0, cpx_imm) X(0xE1, sbc_ind_x) X(0xE2, nop_imm) X(0xE3, isc_ind_x) \
+	X(0xE4, cpx_ind8) X(0xE5, sbc_ind8) X(0xE6, inc_ind8) X(0xE7, isc_ind8) \
+	X(0xE8, inx) X(0xE9, sbc_imm) X(0xEA, nop) X(0xEB, sbc_imm) \
+	X(0xEC, cpx_ind16) X(0xED, sbc_ind16) X(0xEE, inc_ind16) X(0xEF, isc_ind16) \
+	X(0xF0, beq) X(0xF1, sbc_ind_y) X(0xF2, kil) X(0xF3, isc_ind_y) \
+	X(0xF4, nop_ind8_x) X(0xF5, sbc_ind8_x) X(0xF6, inc_ind8_x) X(0xF7, isc_ind8_x) \
+	X(0xF8, sed) X(0xF9, sbc_ind16_y) X(0xFA, nop) X(0xFB, isc_ind16_y) \
+	X(0xFC, nop_ind16_x) X(0xFD, sbc_ind16_x) X(0xFE, inc_ind16_x) X(0xFF, isc_ind16_x)
+
+#define CPU_INSTR_ENTRY(opc, name) [opc] = &name,
+
 const cpu_instr_t *cpu_instr[256] =
 {
-	/* 0x00 */ &brk, &ora_ind_x, &kil, &slo_ind_x,
-	/* 0x04 */ &nop_ind8, &ora_ind8, &asl_ind8, &slo_ind8,
-	/* 0x08 */ &php, &ora_imm, &asl_a, &anc_imm,
-	/* 0x0c */ &nop_ind16, &ora_ind16, &asl_ind16, &slo_ind16,
-	/* 0x10 */ &bpl, &ora_ind_y, &kil, &slo_ind_y,
-	/* 0x14 */ &nop_ind8_x, &ora_ind8_x, &asl_ind8_x, &slo_ind8_x,
-	/* 0x18 */ &clc, &ora_ind16_y, &nop, &slo_ind16_y,
-	/* 0x1C */ &nop_ind16_x, &ora_ind16_x, &asl_ind16_x, &slo_ind16_x,
-	/* 0x20 */ &jsr, &and_ind_x, &kil, &rla_ind_x,
-	/* 0x24 */ &bit_ind8, &and_ind8, &rol_ind8, &rla_ind8,
-	/* 0x28 */ &plp, &and_imm, &rol_a, &anc_imm,
-	/* 0x2C */ &bit_ind16, &and_ind16, &rol_ind16, &rla_ind16,
-	/* 0x30 */ &bmi, &and_ind_y, &kil, &rla_ind_y,
-	/* 0x34 */ &nop_ind8_x, &and_ind8_x, &rol_ind8_x, &rla_ind8_x,
-	/* 0x38 */ &sec, &and_ind16_y, &nop, &rla_ind16_y,
-	/* 0x3C */ &nop_ind16_x, &and_ind16_x, &rol_ind16_x, &rla_ind16_x,
-	/* 0x40 */ &rti, &eor_ind_x, &kil, &sre_ind_x,
-	/* 0x44 */ &nop_ind8, &eor_ind8, &lsr_ind8, &sre_ind8,
-	/* 0x48 */ &pha, &eor_imm, &lsr_a, &alr_imm,
-	/* 0x4C */ &jmp_imm, &eor_ind16, &lsr_ind16, &sre_ind16,
-	/* 0x50 */ &bvc, &eor_ind_y, &kil, &sre_ind_y,
-	/* 0x54 */ &nop_ind8_x, &eor_ind8_x, &lsr_ind8_x, &sre_ind8_x,
-	/* 0x58 */ &cli, &eor_ind16_y, &nop, &sre_ind16_y,
-	/* 0x5C */ &nop_ind16_x, &eor_ind16_x, &lsr_ind16_x, &sre_ind16_x,
-	/* 0x60 */ &rts, &adc_ind_x, &kil, &rra_ind_x,
-	/* 0x64 */ &nop_ind8, &adc_ind8, &ror_ind8, &rra_ind8,
-	/* 0x68 */ &pla, &adc_imm, &ror_a, &arr_imm,
-	/* 0x6C */ &jmp_ind, &adc_ind16, &ror_ind16, &rra_ind16,
-	/* 0x70 */ &bvs, &adc_ind_y, &kil, &rra_ind_y,
-	/* 0x74 */ &nop_ind8_x, &adc_ind8_x, &ror_ind8_x, &rra_ind8_x,
-	/* 0x78 */ &sei, &adc_ind16_y, &nop, &rra_ind16_y,
-	/* 0x7C */ &nop_ind16_x, &adc_ind16_x, &ror_ind16_x, &rra_ind16_x,
-	/* 0x80 */ &nop_imm, &sta_ind_x, &nop_imm, &sax_ind_x,
-	/* 0x84 */ &sty_ind8, &sta_ind8, &stx_ind8, &sax_ind8,
-	/* 0x88 */ &dey, &nop_imm, &txa, &xaa_imm,
-	/* 0x8C */ &sty_ind16, &sta_ind16, &stx_ind16, &sax_ind16,
-	/* 0x90 */ &bcc, &sta_ind_y, &kil, &ahx_ind_y,
-	/* 0x94 */ &sty_ind8_x, &sta_ind8_x, &stx_ind8_y, &sax_ind8_y,
-	/* 0x98 */ &tya, &sta_ind16_y, &txs, &tas_ind16_y,
-	/* 0x9C */ &shy_ind16_x, &sta_ind16_x, &shx_ind16_y, &ahx_ind16_y,
-	/* 0xA0 */ &ldy_imm, &lda_ind_x, &ldx_imm, &lax_ind_x,
-	/* 0xA4 */ &ldy_ind8, &lda_ind8, &ldx_ind8, &lax_ind8,
-	/* 0xA8 */ &tay, &lda_imm, &tax, &lax_imm,
-	/* 0xAC */ &ldy_ind16, &lda_ind16, &ldx_ind16, &lax_ind16,
-	/* 0xB0 */ &bcs, &lda_ind_y, &kil, &lax_ind_y,
-	/* 0xB4 */ &ldy_ind8_x, &lda_ind8_x, &ldx_ind8_y, &lax_ind8_y,
-	/* 0xB8 */ &clv, &lda_ind16_y, &tsx, &las_ind16_y,
-	/* 0xBC */ &ldy_ind16_x, &lda_ind16_x, &ldx_ind16_y, &lax_ind16_y,
-	/* 0xC0 */ &cpy_imm, &cmp_ind_x, &nop_imm, &dcp_ind_x,
-	/* 0xC4 */ &cpy_ind8, &cmp_ind8, &dec_ind8, &dcp_ind8,
-	/* 0xC8 */ &iny, &cmp_imm, &dex, &axs_imm,
-	/* 0xCC */ &cpy_ind16, &cmp_ind16, &dec_ind16, &dcp_ind16,
-	/* 0xD0 */ &bne, &cmp_ind_y, &kil, &dcp_ind_y,
-	/* 0xD4 */ &nop_ind8_x, &cmp_ind8_x, &dec_ind8_x, &dcp_ind8_x,
-	/* 0xD8 */ &cld, &cmp_ind16_y, &nop, &dcp_ind16_y,
-	/* 0xDC */ &nop_ind16_x, &cmp_ind16_x, &dec_ind16_x, &dcp_ind16_x,
-	/* 0xE0 */ &cpx_imm, &sbc_ind_x, &nop_imm, &isc_ind_x,
-	/* 0xE4 */ &cpx_ind8, &sbc_ind8, &inc_ind8, &isc_ind8,
-	/* 0xE8 */ &inx, &sbc_imm, &nop, &sbc_imm,
-	/* 0xEC */ &cpx_ind16, &sbc_ind16, &inc_ind16, &isc_ind16,
-	/* 0xF0 */ &beq, &sbc_ind_y, &kil, &isc_ind_y,
-	/* 0xF4 */ &nop_ind8_x, &sbc_ind8_x, &inc_ind8_x, &isc_ind8_x,
-	/* 0xF8 */ &sed, &sbc_ind16_y, &nop, &isc_ind16_y,
-	/* 0xFC */ &nop_ind16_x, &sbc_ind16_x, &inc_ind16_x, &isc_ind16_x,
+	CPU_OPCODES(CPU_INSTR_ENTRY)
+};
+
+const uint8_t cpu_instr_len[256] =
+{
+	/* 0x00 */ 1, 2, 1, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3,
+	/* 0x10 */ 2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3,
+	/* 0x20 */ 3, 2, 1, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3,
+	/* 0x30 */ 2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3,
+	/* 0x40 */ 1, 2, 1, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3,
+	/* 0x50 */ 2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3,
+	/* 0x60 */ 1, 2, 1, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3,
+	/* 0x70 */ 2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3,
+	/* 0x80 */ 2, 2, 2, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3,
+	/* 0x90 */ 2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3,
+	/* 0xA0 */ 2, 2, 2, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3,
+	/* 0xB0 */ 2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3,
+	/* 0xC0 */ 2, 2, 2, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3,
+	/* 0xD0 */ 2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3,
+	/* 0xE0 */ 2, 2, 2, 2, 2, 2, 2, 2, 1, 2, 1, 2, 3, 3, 3, 3,
+	/* 0xF0 */ 2, 2, 1, 2, 2, 2, 2, 2, 1, 3, 1, 3, 3, 3, 3, 3,
 };
+
+/* base cycles, page crossings and taken branches are added by the
+ * instructions in instr_delay
+ */
+const uint8_t cpu_instr_cycles[256] =
+{
+	/* 0x00 */ 7, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 4, 4, 6, 6,
+	/* 0x10 */ 2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+	/* 0x20 */ 6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 4, 4, 6, 6,
+	/* 0x30 */ 2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+	/* 0x40 */ 6, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 3, 4, 6, 6,
+	/* 0x50 */ 2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+	/* 0x60 */ 6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 5, 4, 6, 6,
+	/* 0x70 */ 2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+	/* 0x80 */ 2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
+	/* 0x90 */ 2, 6, 2, 6, 4, 4, 4, 4, 2, 5, 2, 5, 5, 5, 5, 5,
+	/* 0xA0 */ 2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
+	/* 0xB0 */ 2, 5, 2, 5, 4, 4, 4, 4, 2, 4, 2, 4, 4, 4, 4, 4,
+	/* 0xC0 */ 2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
+	/* 0xD0 */ 2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+	/* 0xE0 */ 2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
+	/* 0xF0 */ 2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+};
+
+#ifdef CPU_SWITCH
+
+#define CPU_INSTR_CASE(opc, name) \
+	case opc: \
+		exec_##name(&local); \
+		break;
+
+/* the fields of the local copy the handlers keep across instructions, a new
+ * one has to be added here or it's lost at the end of every slice, args and
+ * instr_delay don't outlive their instruction
+ */
+static void instr_save(cpu_t *cpu, const cpu_t *local)
+{
+	cpu->regs = local->regs;
+#ifdef CPU_IDLE
+	cpu->idle_regs = local->idle_regs;
+	cpu->idle_cycles = local->idle_cycles;
+	cpu->idle_pc = local->idle_pc;
+#endif
+}
+
+/* registers live in a local copy for the whole slice so that they can stay
+ * in host registers across the memory accesses, flatten makes sure every
+ * exec_* body gets expanded in its case instead of being called
+ */
+#if defined(__GNUC__)
+__attribute__((flatten))
+#endif
+unsigned cpu_instr_run(cpu_t *cpu)
+{
+	cpu_t local = *cpu;
+	unsigned count = 0;
+	do
+	{
+		unsigned cycles = CPU_INSTR_INT_CYCLES;
+		if (cpu->reset)
+		{
+			cpu->reset = 0;
+			exec_reset(&local);
+		}
+		else if (cpu->nmi)
+		{
+			cpu->nmi = 0;
+			exec_nmi(&local);
+		}
+		else if (cpu->irq && !CPU_GET_FLAG_I(&local))
+		{
+			exec_irq(&local);
+		}
+		else
+		{
+			uint8_t opc = cpu_fetch_opc(&local);
+			cycles = cpu_instr_cycles[opc];
+			cpu->instr_cycles = cycles;
+#ifdef CPU_TRACE
+			if (local.trace)
+				cpu_trace_push(local.trace, &local, opc);
+#endif
+			switch (opc)
+			{
+				CPU_OPCODES(CPU_INSTR_CASE)
+			}
+		}
+		cycles += local.instr_delay + cpu->stall;
+		local.instr_delay = 0;
+		cpu->stall = 0;
+		local.cycles += cycles;
+		cpu->cycles = local.cycles;
+		count += cycles;
+	} while (local.cycles * CPU_CLOCK_DIVIDER < cpu->sched->until);
+	instr_save(cpu, &local);
+	return count;
+}
+
+#endif
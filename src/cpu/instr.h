@@ -2,19 +2,28 @@
 #define CPU_INSTR_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 typedef struct cpu cpu_t;
 
 typedef struct cpu_instr
 {
 	void (*exec)(cpu_t *cpu);
-	void (*print)(cpu_t *cpu, char *data, size_t size);
+	void (*print)(const uint8_t *args, char *data, size_t size);
 } cpu_instr_t;
 
 extern const cpu_instr_t *cpu_instr[256];
+extern const uint8_t cpu_instr_len[256];
+extern const uint8_t cpu_instr_cycles[256];
+
+#define CPU_INSTR_INT_CYCLES 7 /* irq, nmi and reset */
 
 extern const cpu_instr_t instr_irq;
 extern const cpu_instr_t instr_nmi;
 extern const cpu_instr_t instr_reset;
 
+#ifdef CPU_SWITCH
+unsigned cpu_instr_run(cpu_t *cpu);
+#endif
+
 #endif
@@ -0,0 +1,1151 @@
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS */
+
+#include "jit.h"
+#include "block.h"
+#include "idle.h"
+#include "instr.h"
+#include "../cpu.h"
+#include "../mem.h"
+#include "../sched.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(__x86_64__)
+#error "the jit only emits x86-64"
+#endif
+
+#ifndef CPU_BLOCK
+#error "the jit compiles the blocks of CPU_BLOCK"
+#endif
+
+#define JIT_BLOCK_MAX 8192 /* host bytes of one block */
+#define JIT_INSTR_MAX 256 /* host bytes of one instruction */
+#define JIT_EXITS_MAX (CPU_BLOCK_SIZE * 2)
+#define JIT_EXIT_SIZE 16 /* host bytes of an exit stub */
+
+enum jit_reg
+{
+	RAX = 0,
+	RCX = 1,
+	RDX = 2,
+	RBX = 3,
+	RSP = 4,
+	RBP = 5,
+	RSI = 6,
+	RDI = 7,
+	R12 = 12,
+	R13 = 13,
+	R14 = 14,
+	R15 = 15,
+};
+
+/* a, x, y and p live in callee saved registers so that helpers can be
+ * called without spilling them, rbx holds the cpu and rbp the ram
+ */
+#define REG_A   R12
+#define REG_X   R13
+#define REG_Y   R14
+#define REG_P   R15
+#define REG_CPU RBX
+#define REG_RAM RBP
+
+#define NO_INDEX -1
+
+#define CPU_OFF(m) ((int32_t)offsetof(cpu_t, m))
+#define RAM_OFF(m) ((int32_t)offsetof(mem_t, m) \
+                  - (int32_t)offsetof(mem_t, wram))
+
+enum jit_kind
+{
+	JIT_NONE, /* calls the interpreter handler */
+	JIT_LD,
+	JIT_ST,
+	JIT_AND,
+	JIT_ORA,
+	JIT_EOR,
+	JIT_ADC,
+	JIT_SBC,
+	JIT_CMP,
+	JIT_BIT,
+	JIT_INC,
+	JIT_DEC,
+	JIT_INR,
+	JIT_DER,
+	JIT_ASL,
+	JIT_LSR,
+	JIT_ROL,
+	JIT_ROR,
+	JIT_TRR,
+	JIT_TXS,
+	JIT_TSX,
+	JIT_CLF,
+	JIT_SEF,
+	JIT_NOP,
+	JIT_PHA,
+	JIT_PHP,
+	JIT_PLA,
+	JIT_BRANCH,
+	JIT_JMP,
+	JIT_JSR,
+	JIT_RTS,
+};
+
+enum jit_mode
+{
+	MODE_IMP,
+	MODE_IMM,
+	MODE_ZP,
+	MODE_ZP_X,
+	MODE_ZP_Y,
+	MODE_ABS,
+	MODE_ABS_X,
+	MODE_ABS_Y,
+	MODE_IND_Y,
+};
+
+typedef struct jit_op
+{
+	uint8_t kind;
+	uint8_t mode;
+	uint8_t reg; /* host register, or flag mask */
+	uint8_t arg; /* source register, or branch condition */
+} jit_op_t;
+
+#define OP(opc, kind, mode, reg, arg) [opc] = {kind, mode, reg, arg},
+
+#define OP_READ(kind, reg, imm, zp, zp_x, abs, abs_x, abs_y, ind_y) \
+	OP(imm, kind, MODE_IMM, reg, 0) \
+	OP(zp, kind, MODE_ZP, reg, 0) \
+	OP(zp_x, kind, MODE_ZP_X, reg, 0) \
+	OP(abs, kind, MODE_ABS, reg, 0) \
+	OP(abs_x, kind, MODE_ABS_X, reg, 0) \
+	OP(abs_y, kind, MODE_ABS_Y, reg, 0) \
+	OP(ind_y, kind, MODE_IND_Y, reg, 0)
+
+/* official opcodes that get host code, indirect x, the read-modify-write
+ * shifts and cli / plp / rti, which can unmask a pending irq, are left to
+ * the handlers through jit_exec
+ */
+static const jit_op_t jit_ops[256] =
+{
+	OP_READ(JIT_LD, REG_A, 0xA9, 0xA5, 0xB5, 0xAD, 0xBD, 0xB9, 0xB1)
+	OP_READ(JIT_AND, REG_A, 0x29, 0x25, 0x35, 0x2D, 0x3D, 0x39, 0x31)
+	OP_READ(JIT_ORA, REG_A, 0x09, 0x05, 0x15, 0x0D, 0x1D, 0x19, 0x11)
+	OP_READ(JIT_EOR, REG_A, 0x49, 0x45, 0x55, 0x4D, 0x5D, 0x59, 0x51)
+	OP_READ(JIT_ADC, REG_A, 0x69, 0x65, 0x75, 0x6D, 0x7D, 0x79, 0x71)
+	OP_READ(JIT_SBC, REG_A, 0xE9, 0xE5, 0xF5, 0xED, 0xFD, 0xF9, 0xF1)
+	OP_READ(JIT_CMP, REG_A, 0xC9, 0xC5, 0xD5, 0xCD, 0xDD, 0xD9, 0xD1)
+	OP(0xA2, JIT_LD, MODE_IMM, REG_X, 0)
+	OP(0xA6, JIT_LD, MODE_ZP, REG_X, 0)
+	OP(0xB6, JIT_LD, MODE_ZP_Y, REG_X, 0)
+	OP(0xAE, JIT_LD, MODE_ABS, REG_X, 0)
+	OP(0xBE, JIT_LD, MODE_ABS_Y, REG_X, 0)
+	OP(0xA0, JIT_LD, MODE_IMM, REG_Y, 0)
+	OP(0xA4, JIT_LD, MODE_ZP, REG_Y, 0)
+	OP(0xB4, JIT_LD, MODE_ZP_X, REG_Y, 0)
+	OP(0xAC, JIT_LD, MODE_ABS, REG_Y, 0)
+	OP(0xBC, JIT_LD, MODE_ABS_X, REG_Y, 0)
+	OP(0x85, JIT_ST, MODE_ZP, REG_A, 0)
+	OP(0x95, JIT_ST, MODE_ZP_X, REG_A, 0)
+	OP(0x8D, JIT_ST, MODE_ABS, REG_A, 0)
+	OP(0x9D, JIT_ST, MODE_ABS_X, REG_A, 0)
+	OP(0x99, JIT_ST, MODE_ABS_Y, REG_A, 0)
+	OP(0x86, JIT_ST, MODE_ZP, REG_X, 0)
+	OP(0x96, JIT_ST, MODE_ZP_Y, REG_X, 0)
+	OP(0x8E, JIT_ST, MODE_ABS, REG_X, 0)
+	OP(0x84, JIT_ST, MODE_ZP, REG_Y, 0)
+	OP(0x94, JIT_ST, MODE_ZP_X, REG_Y, 0)
+	OP(0x8C, JIT_ST, MODE_ABS, REG_Y, 0)
+	OP(0xE0, JIT_CMP, MODE_IMM, REG_X, 0)
+	OP(0xE4, JIT_CMP, MODE_ZP, REG_X, 0)
+	OP(0xEC, JIT_CMP, MODE_ABS, REG_X, 0)
+	OP(0xC0, JIT_CMP, MODE_IMM, REG_Y, 0)
+	OP(0xC4, JIT_CMP, MODE_ZP, REG_Y, 0)
+	OP(0xCC, JIT_CMP, MODE_ABS, REG_Y, 0)
+	OP(0x24, JIT_BIT, MODE_ZP, 0, 0)
+	OP(0x2C, JIT_BIT, MODE_ABS, 0, 0)
+	OP(0xE6, JIT_INC, MODE_ZP, 0, 0)
+	OP(0xF6, JIT_INC, MODE_ZP_X, 0, 0)
+	OP(0xEE, JIT_INC, MODE_ABS, 0, 0)
+	OP(0xFE, JIT_INC, MODE_ABS_X, 0, 0)
+	OP(0xC6, JIT_DEC, MODE_ZP, 0, 0)
+	OP(0xD6, JIT_DEC, MODE_ZP_X, 0, 0)
+	OP(0xCE, JIT_DEC, MODE_ABS, 0, 0)
+	OP(0xDE, JIT_DEC, MODE_ABS_X, 0, 0)
+	OP(0xE8, JIT_INR, MODE_IMP, REG_X, 0)
+	OP(0xC8, JIT_INR, MODE_IMP, REG_Y, 0)
+	OP(0xCA, JIT_DER, MODE_IMP, REG_X, 0)
+	OP(0x88, JIT_DER, MODE_IMP, REG_Y, 0)
+	OP(0x0A, JIT_ASL, MODE_IMP, REG_A, 0)
+	OP(0x4A, JIT_LSR, MODE_IMP, REG_A, 0)
+	OP(0x2A, JIT_ROL, MODE_IMP, REG_A, 0)
+	OP(0x6A, JIT_ROR, MODE_IMP, REG_A, 0)
+	OP(0xAA, JIT_TRR, MODE_IMP, REG_X, REG_A)
+	OP(0xA8, JIT_TRR, MODE_IMP, REG_Y, REG_A)
+	OP(0x8A, JIT_TRR, MODE_IMP, REG_A, REG_X)
+	OP(0x98, JIT_TRR, MODE_IMP, REG_A, REG_Y)
+	OP(0x9A, JIT_TXS, MODE_IMP, 0, 0)
+	OP(0xBA, JIT_TSX, MODE_IMP, 0, 0)
+	OP(0x18, JIT_CLF, MODE_IMP, CPU_FLAG_C, 0)
+	OP(0x38, JIT_SEF, MODE_IMP, CPU_FLAG_C, 0)
+	OP(0xD8, JIT_CLF, MODE_IMP, CPU_FLAG_D, 0)
+	OP(0xF8, JIT_SEF, MODE_IMP, CPU_FLAG_D, 0)
+	OP(0xB8, JIT_CLF, MODE_IMP, CPU_FLAG_V, 0)
+	OP(0x78, JIT_SEF, MODE_IMP, CPU_FLAG_I, 0)
+	OP(0xEA, JIT_NOP, MODE_IMP, 0, 0)
+	OP(0x48, JIT_PHA, MODE_IMP, 0, 0)
+	OP(0x08, JIT_PHP, MODE_IMP, 0, 0)
+	OP(0x68, JIT_PLA, MODE_IMP, 0, 0)
+	OP(0x10, JIT_BRANCH, MODE_IMP, CPU_FLAG_N, 0)
+	OP(0x30, JIT_BRANCH, MODE_IMP, CPU_FLAG_N, 1)
+	OP(0x50, JIT_BRANCH, MODE_IMP, CPU_FLAG_V, 0)
+	OP(0x70, JIT_BRANCH, MODE_IMP, CPU_FLAG_V, 1)
+	OP(0x90, JIT_BRANCH, MODE_IMP, CPU_FLAG_C, 0)
+	OP(0xB0, JIT_BRANCH, MODE_IMP, CPU_FLAG_C, 1)
+	OP(0xD0, JIT_BRANCH, MODE_IMP, CPU_FLAG_Z, 0)
+	OP(0xF0, JIT_BRANCH, MODE_IMP, CPU_FLAG_Z, 1)
+	OP(0x4C, JIT_JMP, MODE_ABS, 0, 0)
+	OP(0x20, JIT_JSR, MODE_ABS, 0, 0)
+	OP(0x60, JIT_RTS, MODE_IMP, 0, 0)
+};
+
+typedef struct jit_exit
+{
+	size_t patch; /* rel32 to point at the exit */
+	uint16_t pc;
+} jit_exit_t;
+
+/* instruction sent back to its handler when its page isn't plain memory */
+typedef struct jit_slow
+{
+	size_t patch[2];
+	uint8_t patch_count;
+	size_t join; /* host code of the next instruction */
+	const cpu_block_instr_t *instr;
+	uint16_t pc;
+	uint16_t next;
+	int last;
+} jit_slow_t;
+
+typedef struct jit_emit
+{
+	uint8_t data[JIT_BLOCK_MAX];
+	size_t len;
+	jit_exit_t exits[JIT_EXITS_MAX];
+	size_t exits_count;
+	jit_slow_t slows[CPU_BLOCK_SIZE];
+	size_t slows_count;
+	size_t slow[2]; /* rel32s to the slow path of the current instruction */
+	uint8_t slow_count;
+} jit_emit_t;
+
+static void e8(jit_emit_t *e, uint8_t v)
+{
+	e->data[e->len++] = v;
+}
+
+static void e16(jit_emit_t *e, uint16_t v)
+{
+	e8(e, v >> 0);
+	e8(e, v >> 8);
+}
+
+static void e32(jit_emit_t *e, uint32_t v)
+{
+	e16(e, v >> 0);
+	e16(e, v >> 16);
+}
+
+static void e64(jit_emit_t *e, uint64_t v)
+{
+	e32(e, v >> 0);
+	e32(e, v >> 32);
+}
+
+static void patch32(jit_emit_t *e, size_t pos, size_t target)
+{
+	uint32_t rel = target - (pos + 4);
+	memcpy(&e->data[pos], &rel, 4);
+}
+
+static void emit_rex(jit_emit_t *e, uint8_t w, uint8_t reg, uint8_t index,
+                     uint8_t base)
+{
+	uint8_t rex = (w << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1)
+	            | (base >> 3);
+	if (rex)
+		e8(e, 0x40 | rex);
+}
+
+static void emit_op(jit_emit_t *e, uint16_t op)
+{
+	if (op > 0xFF)
+		e8(e, op >> 8);
+	e8(e, op);
+}
+
+/* op with a [base + index + disp32] operand, reg is either a register or
+ * the /digit of the opcode, base is never rsp or r12
+ */
+static void emit_mem(jit_emit_t *e, uint8_t w, uint16_t op, uint8_t reg,
+                     uint8_t base, int index, int32_t disp)
+{
+	emit_rex(e, w, reg, index == NO_INDEX ? 0 : index, base);
+	emit_op(e, op);
+	if (index == NO_INDEX)
+	{
+		e8(e, 0x80 | ((reg & 7) << 3) | (base & 7));
+	}
+	else
+	{
+		e8(e, 0x84 | ((reg & 7) << 3));
+		e8(e, ((index & 7) << 3) | (base & 7));
+	}
+	e32(e, disp);
+}
+
+/* op with a register operand in rm */
+static void emit_rr(jit_emit_t *e, uint8_t w, uint16_t op, uint8_t reg,
+                    uint8_t rm)
+{
+	emit_rex(e, w, reg, 0, rm);
+	emit_op(e, op);
+	e8(e, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void emit_load8(jit_emit_t *e, uint8_t dst, uint8_t base, int index,
+                       int32_t disp)
+{
+	emit_mem(e, 0, 0x0FB6, dst, base, index, disp);
+}
+
+static void emit_store8(jit_emit_t *e, uint8_t src, uint8_t base, int index,
+                        int32_t disp)
+{
+	emit_mem(e, 0, 0x88, src, base, index, disp);
+}
+
+static void emit_mov_imm32(jit_emit_t *e, uint8_t reg, uint32_t imm)
+{
+	emit_rex(e, 0, 0, 0, reg);
+	e8(e, 0xB8 | (reg & 7));
+	e32(e, imm);
+}
+
+static void emit_call(jit_emit_t *e, const void *fn)
+{
+	e8(e, 0x48); /* mov rax, imm64 */
+	e8(e, 0xB8);
+	e64(e, (uintptr_t)fn);
+	e8(e, 0xFF); /* call rax */
+	e8(e, 0xD0);
+}
+
+static void emit_cycles(jit_emit_t *e, uint8_t cycles)
+{
+	emit_mem(e, 1, 0x83, 0, REG_CPU, NO_INDEX, CPU_OFF(cycles));
+	e8(e, cycles);
+}
+
+static void emit_test8(jit_emit_t *e, uint8_t reg)
+{
+	emit_rr(e, 0, 0x84, reg, reg);
+}
+
+static void emit_and_p(jit_emit_t *e, uint32_t mask)
+{
+	emit_rr(e, 0, 0x81, 4, REG_P);
+	e32(e, mask);
+}
+
+static void emit_or_p(jit_emit_t *e, uint32_t mask)
+{
+	emit_rr(e, 0, 0x81, 1, REG_P);
+	e32(e, mask);
+}
+
+/* host flags of the last operation into n, z and optionally c and v of
+ * p, c has to be the 6502 carry already, with lahf at 0 ah already holds
+ * the flags
+ */
+static void emit_flags(jit_emit_t *e, uint8_t flags, int lahf)
+{
+	if (flags & CPU_FLAG_V)
+	{
+		e8(e, 0x0F); /* seto dl */
+		e8(e, 0x90);
+		e8(e, 0xC2);
+	}
+	if (lahf)
+		e8(e, 0x9F);
+	if (flags & CPU_FLAG_V)
+	{
+		emit_rr(e, 0, 0x0FB6, RSI, RDX); /* movzx esi, dl */
+		emit_rr(e, 0, 0xC1, 4, RSI); /* shl esi, 6 */
+		e8(e, 6);
+	}
+	e8(e, 0x0F); /* movzx ecx, ah */
+	e8(e, 0xB6);
+	e8(e, 0xCC);
+	emit_rr(e, 0, 0x89, RCX, RDX); /* mov edx, ecx */
+	emit_rr(e, 0, 0x81, 4, RDX); /* and edx, n | c */
+	e32(e, CPU_FLAG_N | (flags & CPU_FLAG_C));
+	emit_rr(e, 0, 0xC1, 5, RCX); /* shr ecx, 5 */
+	e8(e, 5);
+	emit_rr(e, 0, 0x81, 4, RCX); /* and ecx, z */
+	e32(e, CPU_FLAG_Z);
+	emit_rr(e, 0, 0x09, RCX, RDX);
+	if (flags & CPU_FLAG_V)
+		emit_rr(e, 0, 0x09, RSI, RDX);
+	emit_and_p(e, ~(flags | CPU_FLAG_N | CPU_FLAG_Z));
+	emit_rr(e, 0, 0x09, RDX, REG_P);
+}
+
+static void emit_nz(jit_emit_t *e, uint8_t reg)
+{
+	emit_test8(e, reg);
+	emit_flags(e, 0, 1);
+}
+
+static void emit_spill(jit_emit_t *e)
+{
+	emit_store8(e, REG_A, REG_CPU, NO_INDEX, CPU_OFF(regs.a));
+	emit_store8(e, REG_X, REG_CPU, NO_INDEX, CPU_OFF(regs.x));
+	emit_store8(e, REG_Y, REG_CPU, NO_INDEX, CPU_OFF(regs.y));
+	emit_store8(e, REG_P, REG_CPU, NO_INDEX, CPU_OFF(regs.p));
+}
+
+static void emit_reload(jit_emit_t *e)
+{
+	emit_load8(e, REG_A, REG_CPU, NO_INDEX, CPU_OFF(regs.a));
+	emit_load8(e, REG_X, REG_CPU, NO_INDEX, CPU_OFF(regs.x));
+	emit_load8(e, REG_Y, REG_CPU, NO_INDEX, CPU_OFF(regs.y));
+	emit_load8(e, REG_P, REG_CPU, NO_INDEX, CPU_OFF(regs.p));
+}
+
+static void emit_pc(jit_emit_t *e, uint16_t pc)
+{
+	e8(e, 0x66);
+	emit_mem(e, 0, 0xC7, 0, REG_CPU, NO_INDEX, CPU_OFF(regs.pc));
+	e16(e, pc);
+}
+
+/* the epilogue sits at the start of the block code */
+static void emit_leave(jit_emit_t *e)
+{
+	e8(e, 0xE9);
+	e32(e, 0);
+	patch32(e, e->len - 4, 0);
+}
+
+static void emit_exit(jit_emit_t *e, uint16_t pc)
+{
+	emit_pc(e, pc);
+	emit_leave(e);
+}
+
+/* rel32 jumps, patched once the target is known */
+static size_t emit_jcc(jit_emit_t *e, uint8_t cc)
+{
+	e8(e, 0x0F);
+	e8(e, 0x80 | cc);
+	e32(e, 0);
+	return e->len - 4;
+}
+
+static size_t emit_jmp(jit_emit_t *e)
+{
+	e8(e, 0xE9);
+	e32(e, 0);
+	return e->len - 4;
+}
+
+/* jcc to an exit stub emitted after the block */
+static void emit_jcc_exit(jit_emit_t *e, uint8_t cc, uint16_t pc)
+{
+	e->exits[e->exits_count].patch = emit_jcc(e, cc);
+	e->exits[e->exits_count].pc = pc;
+	e->exits_count++;
+}
+
+#define CC_E  0x4
+#define CC_NE 0x5
+#define CC_AE 0x3
+
+/* leaves once the slice is over, like cpu_block_run, and after any io
+ * since it may have switched banks, raised an interrupt or moved the end
+ * of the slice
+ */
+static void emit_check(jit_emit_t *e, uint16_t pc, int io)
+{
+	emit_mem(e, 1, 0x8B, RAX, REG_CPU, NO_INDEX, CPU_OFF(cycles));
+	emit_mem(e, 1, 0x3B, RAX, REG_CPU, NO_INDEX, CPU_OFF(jit_limit));
+	emit_jcc_exit(e, CC_AE, pc);
+	if (!io)
+		return;
+	emit_mem(e, 0, 0x8B, RAX, REG_RAM, NO_INDEX, RAM_OFF(io_count));
+	emit_mem(e, 0, 0x3B, RAX, REG_CPU, NO_INDEX, CPU_OFF(jit_io));
+	emit_jcc_exit(e, CC_NE, pc);
+}
+
+/* esi holds the address */
+static void emit_bus_read(jit_emit_t *e)
+{
+	emit_mem(e, 1, 0x8B, RDI, REG_CPU, NO_INDEX, CPU_OFF(mem));
+	emit_call(e, mem_io_get);
+	emit_rr(e, 0, 0x0FB6, RAX, RAX); /* movzx eax, al */
+}
+
+/* rcx = the rpages (shift MEM_PAGE_SHIFT) or wpages (MEM_WPAGE_SHIFT)
+ * entry of an address, returns the jump taken on NULL pages
+ */
+static size_t emit_page(jit_emit_t *e, int32_t table, uint8_t shift,
+                        uint16_t addr)
+{
+	emit_mem(e, 1, 0x8B, RCX, REG_RAM, NO_INDEX,
+	         table + (addr >> shift) * (int32_t)sizeof(uint8_t *));
+	emit_rr(e, 1, 0x85, RCX, RCX); /* test rcx, rcx */
+	return emit_jcc(e, CC_E);
+}
+
+/* same with the address in reg, edi is used for the entry offset */
+static size_t emit_page_reg(jit_emit_t *e, int32_t table, uint8_t shift,
+                            uint8_t reg)
+{
+	emit_rr(e, 0, 0x89, reg, RDI);
+	emit_rr(e, 0, 0xC1, 5, RDI); /* shr edi, shift - 3 */
+	e8(e, shift - 3);
+	emit_rr(e, 0, 0x81, 4, RDI);
+	e32(e, ((0x10000 >> shift) - 1) * sizeof(uint8_t *));
+	emit_mem(e, 1, 0x8B, RCX, REG_RAM, RDI, table);
+	emit_rr(e, 1, 0x85, RCX, RCX);
+	return emit_jcc(e, CC_E);
+}
+
+/* eax = the byte at esi, through mem_io_get when the page isn't memory */
+static void emit_read_reg(jit_emit_t *e)
+{
+	size_t bus = emit_page_reg(e, RAM_OFF(rpages), MEM_PAGE_SHIFT, RSI);
+	emit_rr(e, 0, 0x89, RSI, RAX);
+	emit_rr(e, 0, 0x81, 4, RAX); /* and eax, MEM_PAGE_MASK */
+	e32(e, MEM_PAGE_MASK);
+	emit_load8(e, RAX, RCX, RAX, 0);
+	size_t done = emit_jmp(e);
+	patch32(e, bus, e->len);
+	emit_bus_read(e);
+	patch32(e, done, e->len);
+}
+
+/* eax = (index + zp) & 0xFF */
+static void emit_zp_index(jit_emit_t *e, uint8_t index, uint8_t zp)
+{
+	emit_mem(e, 0, 0x8D, RAX, index, NO_INDEX, zp);
+	emit_rr(e, 0, 0x0FB6, RAX, RAX);
+}
+
+/* page crossing cycle of base + index, charged after the read as the
+ * handlers only charge it once the instruction is done
+ */
+static void emit_cross(jit_emit_t *e, uint8_t index, uint8_t lo)
+{
+	emit_mem(e, 0, 0x8D, RCX, index, NO_INDEX, lo);
+	emit_rr(e, 0, 0xC1, 5, RCX); /* shr ecx, 8 */
+	e8(e, 8);
+	emit_mem(e, 1, 0x01, RCX, REG_CPU, NO_INDEX, CPU_OFF(cycles));
+}
+
+static uint16_t instr_abs(const cpu_block_instr_t *instr)
+{
+	return instr->args[0] | (instr->args[1] << 8);
+}
+
+/* operand of a read into eax, returns 1 when it may have done io */
+static int emit_read(jit_emit_t *e, const jit_op_t *op,
+                     const cpu_block_instr_t *instr)
+{
+	uint16_t abs = instr_abs(instr);
+	switch (op->mode)
+	{
+		case MODE_IMM:
+			emit_mov_imm32(e, RAX, instr->args[0]);
+			return 0;
+		case MODE_ZP:
+			emit_load8(e, RAX, REG_RAM, NO_INDEX, instr->args[0]);
+			return 0;
+		case MODE_ZP_X:
+		case MODE_ZP_Y:
+			emit_zp_index(e, op->mode == MODE_ZP_X ? REG_X : REG_Y,
+			              instr->args[0]);
+			emit_load8(e, RAX, REG_RAM, RAX, 0);
+			return 0;
+		case MODE_ABS:
+		{
+			if (abs < 0x2000)
+			{
+				emit_load8(e, RAX, REG_RAM, NO_INDEX, abs & 0x7FF);
+				return 0;
+			}
+			size_t bus = emit_page(e, RAM_OFF(rpages), MEM_PAGE_SHIFT, abs);
+			emit_load8(e, RAX, RCX, NO_INDEX, abs & MEM_PAGE_MASK);
+			size_t done = emit_jmp(e);
+			patch32(e, bus, e->len);
+			emit_mov_imm32(e, RSI, abs);
+			emit_bus_read(e);
+			patch32(e, done, e->len);
+			return 1;
+		}
+		case MODE_ABS_X:
+		case MODE_ABS_Y:
+		{
+			uint8_t index = op->mode == MODE_ABS_X ? REG_X : REG_Y;
+			emit_mem(e, 0, 0x8D, RAX, index, NO_INDEX, abs);
+			if (abs + 0xFF < 0x2000)
+			{
+				emit_rr(e, 0, 0x81, 4, RAX); /* and eax, 0x7FF */
+				e32(e, 0x7FF);
+				emit_load8(e, RAX, REG_RAM, RAX, 0);
+				emit_cross(e, index, abs & 0xFF);
+				return 0;
+			}
+			emit_rr(e, 0, 0x0FB7, RSI, RAX); /* movzx esi, ax */
+			emit_read_reg(e);
+			emit_cross(e, index, abs & 0xFF);
+			return 1;
+		}
+		case MODE_IND_Y:
+			emit_mem(e, 0, 0x0FB7, RSI, REG_RAM, NO_INDEX, instr->args[0]);
+			emit_rr(e, 0, 0x01, REG_Y, RSI);
+			emit_rr(e, 0, 0x0FB7, RSI, RSI); /* movzx esi, si */
+			emit_read_reg(e);
+			emit_load8(e, RCX, REG_RAM, NO_INDEX, instr->args[0]);
+			emit_rr(e, 0, 0x01, REG_Y, RCX);
+			emit_rr(e, 0, 0xC1, 5, RCX); /* shr ecx, 8 */
+			e8(e, 8);
+			emit_mem(e, 1, 0x01, RCX, REG_CPU, NO_INDEX, CPU_OFF(cycles));
+			return 1;
+	}
+	return 0;
+}
+
+static void emit_slow(jit_emit_t *e, size_t patch)
+{
+	e->slow[e->slow_count++] = patch;
+}
+
+/* ram holding cpu blocks is write protected by mem_protect, writing it
+ * then goes through the handler so that mem_io_set sees it
+ */
+static void emit_protect(jit_emit_t *e, uint16_t addr)
+{
+	emit_mem(e, 1, 0x83, 7, REG_RAM, NO_INDEX, RAM_OFF(wpages)
+	       + (addr >> MEM_WPAGE_SHIFT) * (int32_t)sizeof(uint8_t *));
+	e8(e, 0);
+	emit_slow(e, emit_jcc(e, CC_E));
+}
+
+/* address of a write, returns 0 when it is a constant, 1 when it is in eax */
+static int emit_write_addr(jit_emit_t *e, const jit_op_t *op,
+                           const cpu_block_instr_t *instr, uint16_t *addr)
+{
+	switch (op->mode)
+	{
+		case MODE_ZP:
+			*addr = instr->args[0];
+			return 0;
+		case MODE_ABS:
+			*addr = instr_abs(instr);
+			return 0;
+		case MODE_ZP_X:
+		case MODE_ZP_Y:
+			emit_zp_index(e, op->mode == MODE_ZP_X ? REG_X : REG_Y,
+			              instr->args[0]);
+			return 1;
+		case MODE_ABS_X:
+		case MODE_ABS_Y:
+			emit_mem(e, 0, 0x8D, RAX, op->mode == MODE_ABS_X ? REG_X
+			                                                 : REG_Y,
+			         NO_INDEX, instr_abs(instr));
+			emit_rr(e, 0, 0x0FB7, RAX, RAX); /* movzx eax, ax */
+			return 1;
+	}
+	return 0;
+}
+
+/* edx = the byte a read-modify-write starts from, through rpages as
+ * mem_get would, pages that aren't memory go to the handler
+ */
+static void emit_rmw_read(jit_emit_t *e, int reg, uint16_t addr)
+{
+	if (!reg)
+	{
+		emit_slow(e, emit_page(e, RAM_OFF(rpages), MEM_PAGE_SHIFT, addr));
+		emit_load8(e, RDX, RCX, NO_INDEX, addr & MEM_PAGE_MASK);
+		return;
+	}
+	emit_slow(e, emit_page_reg(e, RAM_OFF(rpages), MEM_PAGE_SHIFT, RAX));
+	emit_rr(e, 0, 0x89, RAX, RSI);
+	emit_rr(e, 0, 0x81, 4, RSI); /* and esi, MEM_PAGE_MASK */
+	e32(e, MEM_PAGE_MASK);
+	emit_load8(e, RDX, RCX, RSI, 0);
+}
+
+/* write operand as [rcx + index + disp] through wpages, pages that aren't
+ * memory go to the handler, which also covers io and protected ram
+ */
+static void emit_write_op(jit_emit_t *e, int reg, uint16_t addr, int *index,
+                          int32_t *disp)
+{
+	if (!reg)
+	{
+		emit_slow(e, emit_page(e, RAM_OFF(wpages), MEM_WPAGE_SHIFT, addr));
+		*index = NO_INDEX;
+		*disp = addr & MEM_WPAGE_MASK;
+		return;
+	}
+	emit_slow(e, emit_page_reg(e, RAM_OFF(wpages), MEM_WPAGE_SHIFT, RAX));
+	emit_rr(e, 0, 0x81, 4, RAX); /* and eax, MEM_WPAGE_MASK */
+	e32(e, MEM_WPAGE_MASK);
+	*index = RAX;
+	*disp = 0;
+}
+
+/* the handler runs with the registers back in the cpu, it leaves when it
+ * jumped or when cpu_block_run would have
+ */
+static int jit_exec(cpu_t *cpu, const cpu_block_instr_t *instr,
+                    uint16_t next)
+{
+	cpu->args = instr->args;
+	cpu->instr_cycles = instr->cycles;
+	instr->exec(cpu);
+	cpu->cycles += instr->cycles + cpu->instr_delay + cpu->stall;
+	cpu->instr_delay = 0;
+	cpu->stall = 0;
+	return cpu->regs.pc != next
+	    || cpu->cycles >= cpu->jit_limit
+	    || cpu->mem->io_count != cpu->jit_io
+	    || (cpu->irq && !CPU_GET_FLAG_I(cpu));
+}
+
+static void emit_handler(jit_emit_t *e, const cpu_block_instr_t *instr,
+                         uint16_t pc, uint16_t next, int last)
+{
+	emit_spill(e);
+	emit_pc(e, pc + 1);
+	emit_rr(e, 1, 0x89, REG_CPU, RDI); /* mov rdi, rbx */
+	e8(e, 0x48); /* mov rsi, imm64 */
+	e8(e, 0xBE);
+	e64(e, (uintptr_t)instr);
+	emit_mov_imm32(e, RDX, next);
+	emit_call(e, jit_exec);
+	emit_reload(e);
+	if (last)
+	{
+		emit_leave(e);
+		return;
+	}
+	emit_rr(e, 0, 0x85, RAX, RAX); /* test eax, eax */
+	e8(e, 0x0F); /* jnz epilogue */
+	e8(e, 0x85);
+	e32(e, 0);
+	patch32(e, e->len - 4, 0);
+}
+
+#ifdef CPU_IDLE
+static void jit_idle(cpu_t *cpu, uint16_t from)
+{
+	cpu_idle(cpu, from);
+	cpu->cycles += cpu->instr_delay;
+	cpu->instr_delay = 0;
+}
+#endif
+
+/* backward jumps go through cpu_idle as they do in the interpreter,
+ * before the jump itself is charged
+ */
+static void emit_jump(jit_emit_t *e, uint16_t from, uint16_t to,
+                      uint8_t cycles)
+{
+#ifdef CPU_IDLE
+	if (to <= from)
+	{
+		emit_spill(e);
+		emit_pc(e, to);
+		emit_rr(e, 1, 0x89, REG_CPU, RDI); /* mov rdi, rbx */
+		emit_mov_imm32(e, RSI, from);
+		emit_call(e, jit_idle);
+	}
+#else
+	(void)from;
+#endif
+	emit_cycles(e, cycles);
+	emit_exit(e, to);
+}
+
+static void emit_push(jit_emit_t *e, uint8_t reg)
+{
+	emit_protect(e, 0x100);
+	emit_load8(e, RAX, REG_CPU, NO_INDEX, CPU_OFF(regs.s));
+	emit_store8(e, reg, REG_RAM, RAX, 0x100);
+	emit_rr(e, 0, 0xFE, 1, RAX); /* dec al */
+	emit_store8(e, RAX, REG_CPU, NO_INDEX, CPU_OFF(regs.s));
+}
+
+/* returns 0 if the instruction has to go through its handler */
+static int emit_instr(jit_emit_t *e, const cpu_block_instr_t *instr,
+                      uint16_t pc, uint16_t next, int last)
+{
+	const jit_op_t *op = &jit_ops[instr->opc];
+	uint16_t addr;
+	int reg;
+	int index;
+	int32_t disp;
+	int io = 0;
+	if (op->mode == MODE_IND_Y && instr->args[0] == 0xFF)
+		return 0; /* pointer wraps around the zero page */
+	switch (op->kind)
+	{
+		case JIT_NONE:
+			return 0;
+		case JIT_LD:
+			io = emit_read(e, op, instr);
+			emit_rr(e, 0, 0x89, RAX, op->reg);
+			emit_nz(e, op->reg);
+			break;
+		case JIT_ST:
+			reg = emit_write_addr(e, op, instr, &addr);
+			emit_write_op(e, reg, addr, &index, &disp);
+			emit_store8(e, op->reg, RCX, index, disp);
+			break;
+		case JIT_AND:
+		case JIT_ORA:
+		case JIT_EOR:
+		{
+			static const uint8_t alu[] =
+			{
+				[JIT_AND] = 0x20,
+				[JIT_ORA] = 0x08,
+				[JIT_EOR] = 0x30,
+			};
+			io = emit_read(e, op, instr);
+			emit_rr(e, 0, alu[op->kind], RAX, REG_A);
+			emit_flags(e, 0, 1);
+			break;
+		}
+		case JIT_ADC:
+		case JIT_SBC:
+			io = emit_read(e, op, instr);
+			if (op->kind == JIT_SBC)
+				emit_rr(e, 0, 0xF6, 2, RAX); /* not al */
+			emit_rr(e, 0, 0x0FBA, 4, REG_P); /* bt r15d, 0 */
+			e8(e, 0);
+			emit_rr(e, 0, 0x10, RAX, REG_A); /* adc r12b, al */
+			emit_flags(e, CPU_FLAG_C | CPU_FLAG_V, 1);
+			break;
+		case JIT_CMP:
+			io = emit_read(e, op, instr);
+			emit_rr(e, 0, 0x38, RAX, op->reg);
+			e8(e, 0xF5); /* cmc */
+			emit_flags(e, CPU_FLAG_C, 1);
+			break;
+		case JIT_BIT:
+			io = emit_read(e, op, instr);
+			emit_rr(e, 0, 0x84, RAX, REG_A);
+			e8(e, 0x0F); /* setz cl */
+			e8(e, 0x94);
+			e8(e, 0xC1);
+			emit_rr(e, 0, 0x0FB6, RCX, RCX);
+			emit_rr(e, 0, 0x01, RCX, RCX);
+			emit_rr(e, 0, 0x81, 4, RAX);
+			e32(e, CPU_FLAG_N | CPU_FLAG_V);
+			emit_rr(e, 0, 0x09, RCX, RAX);
+			emit_and_p(e, ~(CPU_FLAG_N | CPU_FLAG_V | CPU_FLAG_Z));
+			emit_rr(e, 0, 0x09, RAX, REG_P);
+			break;
+		case JIT_INC:
+		case JIT_DEC:
+			reg = emit_write_addr(e, op, instr, &addr);
+			emit_rmw_read(e, reg, addr);
+			emit_write_op(e, reg, addr, &index, &disp);
+			emit_rr(e, 0, 0xFE, op->kind == JIT_DEC, RDX); /* inc/dec dl */
+			emit_store8(e, RDX, RCX, index, disp);
+			emit_flags(e, 0, 1);
+			break;
+		case JIT_INR:
+		case JIT_DER:
+			emit_rr(e, 0, 0xFE, op->kind == JIT_DER, op->reg);
+			emit_flags(e, 0, 1);
+			break;
+		case JIT_ASL:
+		case JIT_LSR:
+			emit_rr(e, 0, 0xD0, op->kind == JIT_ASL ? 4 : 5, REG_A);
+			emit_flags(e, CPU_FLAG_C, 1);
+			break;
+		case JIT_ROL:
+		case JIT_ROR:
+			emit_rr(e, 0, 0x0FBA, 4, REG_P); /* bt r15d, 0 */
+			e8(e, 0);
+			emit_rr(e, 0, 0xD0, op->kind == JIT_ROL ? 2 : 3, REG_A);
+			e8(e, 0x0F); /* setc dl */
+			e8(e, 0x92);
+			e8(e, 0xC2);
+			emit_test8(e, REG_A);
+			e8(e, 0x9F); /* lahf */
+			e8(e, 0x80); /* and ah, 0xFE */
+			e8(e, 0xE4);
+			e8(e, 0xFE);
+			e8(e, 0x08); /* or ah, dl */
+			e8(e, 0xD4);
+			emit_flags(e, CPU_FLAG_C, 0);
+			break;
+		case JIT_TRR:
+			emit_rr(e, 0, 0x89, op->arg, op->reg);
+			emit_nz(e, op->reg);
+			break;
+		case JIT_TXS:
+			emit_store8(e, REG_X, REG_CPU, NO_INDEX, CPU_OFF(regs.s));
+			break;
+		case JIT_TSX:
+			emit_load8(e, REG_X, REG_CPU, NO_INDEX, CPU_OFF(regs.s));
+			emit_nz(e, REG_X);
+			break;
+		case JIT_CLF:
+			emit_and_p(e, ~op->reg);
+			break;
+		case JIT_SEF:
+			emit_or_p(e, op->reg);
+			break;
+		case JIT_NOP:
+			break;
+		case JIT_PHA:
+			emit_push(e, REG_A);
+			break;
+		case JIT_PHP:
+			emit_rr(e, 0, 0x89, REG_P, RCX);
+			emit_rr(e, 0, 0x81, 1, RCX); /* or ecx, 0x30 */
+			e32(e, 0x30);
+			emit_push(e, RCX);
+			break;
+		case JIT_PLA:
+			emit_load8(e, RAX, REG_CPU, NO_INDEX, CPU_OFF(regs.s));
+			emit_rr(e, 0, 0xFE, 0, RAX); /* inc al */
+			emit_store8(e, RAX, REG_CPU, NO_INDEX, CPU_OFF(regs.s));
+			emit_load8(e, REG_A, REG_RAM, RAX, 0x100);
+			emit_nz(e, REG_A);
+			break;
+		case JIT_BRANCH:
+		{
+			uint16_t to = next + (int8_t)instr->args[0];
+			size_t skip;
+			emit_rr(e, 0, 0xF6, 0, REG_P); /* test r15b, flag */
+			e8(e, op->reg);
+			e8(e, 0x0F);
+			e8(e, op->arg ? 0x84 : 0x85);
+			e32(e, 0);
+			skip = e->len;
+			emit_jump(e, pc, to, instr->cycles + 1 + ((to ^ next) > 0xFF));
+			patch32(e, skip - 4, e->len);
+			emit_cycles(e, instr->cycles);
+			emit_exit(e, next);
+			return 1;
+		}
+		case JIT_JMP:
+			emit_jump(e, pc, instr_abs(instr), instr->cycles);
+			return 1;
+		case JIT_JSR:
+			emit_protect(e, 0x100);
+			emit_load8(e, RAX, REG_CPU, NO_INDEX, CPU_OFF(regs.s));
+			emit_mem(e, 0, 0xC6, 0, REG_RAM, RAX, 0x100);
+			e8(e, (uint16_t)(next - 1) >> 8);
+			emit_rr(e, 0, 0xFE, 1, RAX); /* dec al */
+			emit_mem(e, 0, 0xC6, 0, REG_RAM, RAX, 0x100);
+			e8(e, next - 1);
+			emit_rr(e, 0, 0xFE, 1, RAX);
+			emit_store8(e, RAX, REG_CPU, NO_INDEX, CPU_OFF(regs.s));
+			emit_cycles(e, instr->cycles);
+			emit_exit(e, instr_abs(instr));
+			return 1;
+		case JIT_RTS:
+			emit_load8(e, RAX, REG_CPU, NO_INDEX, CPU_OFF(regs.s));
+			emit_rr(e, 0, 0xFE, 0, RAX); /* inc al */
+			emit_load8(e, RCX, REG_RAM, RAX, 0x100);
+			emit_rr(e, 0, 0xFE, 0, RAX);
+			emit_load8(e, RDX, REG_RAM, RAX, 0x100);
+			emit_store8(e, RAX, REG_CPU, NO_INDEX, CPU_OFF(regs.s));
+			emit_rr(e, 0, 0xC1, 4, RDX); /* shl edx, 8 */
+			e8(e, 8);
+			emit_rr(e, 0, 0x09, RDX, RCX);
+			emit_rr(e, 0, 0xFF, 0, RCX); /* inc ecx */
+			e8(e, 0x66);
+			emit_mem(e, 0, 0x89, RCX, REG_CPU, NO_INDEX, CPU_OFF(regs.pc));
+			emit_cycles(e, instr->cycles);
+			emit_leave(e);
+			return 1;
+	}
+	emit_cycles(e, instr->cycles);
+	if (last)
+		emit_exit(e, next);
+	else
+		emit_check(e, next, io);
+	return 1;
+}
+
+cpu_jit_t *cpu_jit_new(cpu_blocks_t *blocks)
+{
+	cpu_jit_t *jit = calloc(sizeof(*jit), 1);
+	if (!jit)
+		return NULL;
+	jit->blocks = blocks;
+	jit->emit = malloc(sizeof(*jit->emit));
+	if (!jit->emit)
+	{
+		free(jit);
+		return NULL;
+	}
+	jit->size = CPU_JIT_SIZE;
+	jit->code = mmap(NULL, jit->size, PROT_READ | PROT_EXEC,
+	                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (jit->code == MAP_FAILED)
+	{
+		free(jit->emit);
+		free(jit);
+		return NULL;
+	}
+	return jit;
+}
+
+void cpu_jit_del(cpu_jit_t *jit)
+{
+	if (!jit)
+		return;
+	munmap(jit->code, jit->size);
+	free(jit->emit);
+	free(jit);
+}
+
+/* a full mapping starts over, no compiled code runs while this does and the
+ * blocks that were in it get compiled again once they're hot again
+ */
+int cpu_jit_compile(cpu_jit_t *jit, cpu_block_t *block, uint16_t pc)
+{
+	jit_emit_t *e = jit->emit;
+	size_t entry;
+	e->len = 0;
+	e->exits_count = 0;
+	e->slows_count = 0;
+	emit_spill(e);
+	e8(e, 0x48); /* add rsp, 8 */
+	e8(e, 0x83);
+	e8(e, 0xC4);
+	e8(e, 0x08);
+	e8(e, 0x41); /* pop r15 */
+	e8(e, 0x5F);
+	e8(e, 0x41); /* pop r14 */
+	e8(e, 0x5E);
+	e8(e, 0x41); /* pop r13 */
+	e8(e, 0x5D);
+	e8(e, 0x41); /* pop r12 */
+	e8(e, 0x5C);
+	e8(e, 0x5D); /* pop rbp */
+	e8(e, 0x5B); /* pop rbx */
+	e8(e, 0xC3); /* ret */
+	entry = e->len;
+	e8(e, 0x53); /* push rbx */
+	e8(e, 0x55); /* push rbp */
+	e8(e, 0x41); /* push r12 */
+	e8(e, 0x54);
+	e8(e, 0x41); /* push r13 */
+	e8(e, 0x55);
+	e8(e, 0x41); /* push r14 */
+	e8(e, 0x56);
+	e8(e, 0x41); /* push r15 */
+	e8(e, 0x57);
+	e8(e, 0x48); /* sub rsp, 8 */
+	e8(e, 0x83);
+	e8(e, 0xEC);
+	e8(e, 0x08);
+	emit_rr(e, 1, 0x89, RDI, REG_CPU); /* mov rbx, rdi */
+	emit_mem(e, 1, 0x8B, REG_RAM, REG_CPU, NO_INDEX, CPU_OFF(mem));
+	emit_rr(e, 1, 0x81, 0, REG_RAM); /* add rbp, wram */
+	e32(e, offsetof(mem_t, wram));
+	emit_reload(e);
+	for (uint8_t i = 0; i < block->count; ++i)
+	{
+		const cpu_block_instr_t *instr = &block->instr[i];
+		uint16_t next = pc + cpu_instr_len[instr->opc];
+		int last = i == block->count - 1;
+		if (!last && e->len + JIT_INSTR_MAX * (e->slows_count + 2)
+		           + JIT_EXIT_SIZE * (e->exits_count + 2) > JIT_BLOCK_MAX)
+		{
+			emit_exit(e, pc);
+			break;
+		}
+		e->slow_count = 0;
+		if (!emit_instr(e, instr, pc, next, last))
+		{
+			emit_handler(e, instr, pc, next, last);
+		}
+		else if (e->slow_count)
+		{
+			jit_slow_t *slow = &e->slows[e->slows_count++];
+			slow->patch[0] = e->slow[0];
+			slow->patch[1] = e->slow[1];
+			slow->patch_count = e->slow_count;
+			slow->join = e->len;
+			slow->instr = instr;
+			slow->pc = pc;
+			slow->next = next;
+			slow->last = last;
+		}
+		pc = next;
+	}
+	for (size_t i = 0; i < e->exits_count; ++i)
+	{
+		patch32(e, e->exits[i].patch, e->len);
+		emit_exit(e, e->exits[i].pc);
+	}
+	for (size_t i = 0; i < e->slows_count; ++i)
+	{
+		jit_slow_t *slow = &e->slows[i];
+		for (uint8_t j = 0; j < slow->patch_count; ++j)
+			patch32(e, slow->patch[j], e->len);
+		emit_handler(e, slow->instr, slow->pc, slow->next, slow->last);
+		if (slow->last)
+			continue;
+		e8(e, 0xE9); /* jmp join */
+		e32(e, 0);
+		patch32(e, e->len - 4, slow->join);
+	}
+	if (jit->used + e->len > jit->size)
+	{
+		cpu_blocks_drop_code(jit->blocks);
+		jit->used = 0;
+	}
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t start = jit->used & ~(page - 1);
+	size_t end = (jit->used + e->len + page - 1) & ~(page - 1);
+	if (mprotect(jit->code + start, end - start, PROT_READ | PROT_WRITE))
+		return 0;
+	memcpy(jit->code + jit->used, e->data, e->len);
+	if (mprotect(jit->code + start, end - start, PROT_READ | PROT_EXEC))
+		return 0;
+	__builtin___clear_cache((char *)jit->code + jit->used,
+	                        (char *)jit->code + jit->used + e->len);
+	block->code = (void (*)(cpu_t *))(jit->code + jit->used + entry);
+	jit->used = (jit->used + e->len + 15) & ~(size_t)15;
+	return 1;
+}
+
+unsigned cpu_jit_run(cpu_t *cpu, const cpu_block_t *block)
+{
+	uint64_t cycles = cpu->cycles;
+	uint64_t until = cpu->sched->until;
+	cpu->jit_limit = until / CPU_CLOCK_DIVIDER
+	               + (until % CPU_CLOCK_DIVIDER != 0);
+	cpu->jit_io = cpu->mem->io_count;
+	block->code(cpu);
+	return cpu->cycles - cycles;
+}
@@ -0,0 +1,33 @@
+#ifndef CPU_JIT_H
+#define CPU_JIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CPU_JIT_SIZE (16 * 1024 * 1024) /* bytes of host code */
+#define CPU_JIT_HOT  8 /* runs of a block before it gets compiled */
+
+typedef struct cpu cpu_t;
+typedef struct cpu_block cpu_block_t;
+typedef struct cpu_blocks cpu_blocks_t;
+typedef struct jit_emit jit_emit_t;
+
+/* single executable mapping the blocks get appended to, it is only made
+ * writable while a block is being copied in, and emptied out once full
+ */
+typedef struct cpu_jit
+{
+	cpu_blocks_t *blocks; /* whose code is in the mapping */
+	uint8_t *code;
+	size_t size;
+	size_t used;
+	jit_emit_t *emit; /* where cpu_jit_compile builds a block */
+} cpu_jit_t;
+
+cpu_jit_t *cpu_jit_new(cpu_blocks_t *blocks);
+void cpu_jit_del(cpu_jit_t *jit);
+
+int cpu_jit_compile(cpu_jit_t *jit, cpu_block_t *block, uint16_t pc);
+unsigned cpu_jit_run(cpu_t *cpu, const cpu_block_t *block);
+
+#endif
@@ -0,0 +1,82 @@
+#include "trace.h"
+#include "instr.h"
+#include "../cpu.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+cpu_trace_t *cpu_trace_new(size_t size)
+{
+	if (!size || (size & (size - 1)))
+		return NULL;
+	cpu_trace_t *trace = calloc(sizeof(*trace), 1);
+	if (!trace)
+		return NULL;
+	trace->entries = malloc(sizeof(*trace->entries) * size);
+	if (!trace->entries)
+	{
+		free(trace);
+		return NULL;
+	}
+	trace->size = size;
+	return trace;
+}
+
+void cpu_trace_del(cpu_trace_t *trace)
+{
+	if (!trace)
+		return;
+	free(trace->entries);
+	free(trace);
+}
+
+/* called with pc right after the opcode byte and args already fetched,
+ * reading the operands again could hit io and change what runs
+ */
+void cpu_trace_push(cpu_trace_t *trace, cpu_t *cpu, uint8_t opc)
+{
+	cpu_trace_entry_t *entry = &trace->entries[trace->pos++ & (trace->size - 1)];
+	entry->cycle = cpu->cycles;
+	entry->pc = cpu->regs.pc - 1;
+	entry->opc = opc;
+	entry->args[0] = cpu_instr_len[opc] > 1 ? cpu->args[0] : 0;
+	entry->args[1] = cpu_instr_len[opc] > 2 ? cpu->args[1] : 0;
+	entry->a = cpu->regs.a;
+	entry->x = cpu->regs.x;
+	entry->y = cpu->regs.y;
+	entry->s = cpu->regs.s;
+	entry->p = cpu->regs.p;
+}
+
+/* nestest.log layout, PPU position is derived from the cpu cycle */
+static void print_entry(const cpu_trace_entry_t *entry, FILE *fp)
+{
+	char bytes[16];
+	char disasm[64];
+	uint8_t len = cpu_instr_len[entry->opc];
+	if (len == 1)
+		snprintf(bytes, sizeof(bytes), "%02" PRIX8, entry->opc);
+	else if (len == 2)
+		snprintf(bytes, sizeof(bytes), "%02" PRIX8 " %02" PRIX8,
+		         entry->opc, entry->args[0]);
+	else
+		snprintf(bytes, sizeof(bytes), "%02" PRIX8 " %02" PRIX8 " %02" PRIX8,
+		         entry->opc, entry->args[0], entry->args[1]);
+	cpu_instr[entry->opc]->print(entry->args, disasm, sizeof(disasm));
+	for (char *c = disasm; *c; ++c)
+		*c = toupper(*c);
+	uint64_t dot = entry->cycle * 3;
+	fprintf(fp, "%04" PRIX16 "  %-10s%-32sA:%02" PRIX8 " X:%02" PRIX8
+	        " Y:%02" PRIX8 " P:%02" PRIX8 " SP:%02" PRIX8
+	        " PPU:%3u,%3u CYC:%" PRIu64 "\n",
+	        entry->pc, bytes, disasm, entry->a, entry->x, entry->y,
+	        entry->p, entry->s, (unsigned)(dot / 341 % 262),
+	        (unsigned)(dot % 341), entry->cycle);
+}
+
+void cpu_trace_print(const cpu_trace_t *trace, FILE *fp)
+{
+	size_t start = trace->pos > trace->size ? trace->pos - trace->size : 0;
+	for (size_t i = start; i < trace->pos; ++i)
+		print_entry(&trace->entries[i & (trace->size - 1)], fp);
+}
@@ -0,0 +1,39 @@
+#ifndef CPU_TRACE_H
+#define CPU_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct cpu cpu_t;
+
+typedef struct cpu_trace_entry
+{
+	uint64_t cycle;
+	uint16_t pc;
+	uint8_t opc;
+	uint8_t args[2];
+	uint8_t a;
+	uint8_t x;
+	uint8_t y;
+	uint8_t s;
+	uint8_t p;
+} cpu_trace_entry_t;
+
+/* ring of the last executed instructions, size is a power of two and pos
+ * is the total number of entries ever pushed
+ */
+typedef struct cpu_trace
+{
+	cpu_trace_entry_t *entries;
+	size_t size;
+	size_t pos;
+} cpu_trace_t;
+
+cpu_trace_t *cpu_trace_new(size_t size);
+void cpu_trace_del(cpu_trace_t *trace);
+
+void cpu_trace_push(cpu_trace_t *trace, cpu_t *cpu, uint8_t opc);
+void cpu_trace_print(const cpu_trace_t *trace, FILE *fp);
+
+#endif
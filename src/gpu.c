@@ -1,11 +1,58 @@
 #include "gpu.h"
 #include "mem.h"
+#include "mbc.h"
 #include "nes.h"
 #include "cpu.h"
+#include "sched.h"
+#include "gpu/pixel.h"
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdio.h>
 
+/* XRGB8888 */
+static const uint32_t colors[0x40] =
+{
+	0x7C7C7C, 0x0000FC, 0x0000BC, 0x4428BC,
+	0x940084, 0xA80020, 0xA81000, 0x881400,
+	0x503000, 0x007800, 0x006800, 0x005800,
+	0x004058, 0x000000, 0x000000, 0x000000,
+	0xBCBCBC, 0x0078F8, 0x0058F8, 0x6844FC,
+	0xD800CC, 0xE40058, 0xF83800, 0xE45C10,
+	0xAC7C00, 0x00B800, 0x00A800, 0x00A844,
+	0x008888, 0x000000, 0x000000, 0x000000,
+	0xF8F8F8, 0x3CBCFC, 0x6888FC, 0x9878F8,
+	0xF878F8, 0xF85898, 0xF87858, 0xFCA044,
+	0xF8B800, 0xB8F818, 0x58D854, 0x58F898,
+	0x00E8D8, 0x787878, 0x000000, 0x000000,
+	0xFCFCFC, 0xA4E4FC, 0xB8B8F8, 0xD8B8F8,
+	0xF8B8F8, 0xF8A4C0, 0xF0D0B0, 0xFCE0A8,
+	0xF8D878, 0xD8F878, 0xB8F8B8, 0xB8F8D8,
+	0x00FCFC, 0xF8D8F8, 0x000000, 0x000000,
+};
+
+/* emphasis dims the two other channels, bit 0 is red, 1 green and 2 blue */
+static void gpu_init_luts(gpu_t *gpu)
+{
+	for (uint8_t e = 0; e < 8; ++e)
+	{
+		for (uint8_t i = 0; i < 64; ++i)
+		{
+			uint32_t r = (colors[i] >> 16) & 0xFF;
+			uint32_t g = (colors[i] >> 8) & 0xFF;
+			uint32_t b = (colors[i] >> 0) & 0xFF;
+			if (e & ~1)
+				r = r * 3 / 4;
+			if (e & ~2)
+				g = g * 3 / 4;
+			if (e & ~4)
+				b = b * 3 / 4;
+			gpu->rgb32[e][i] = 0xFF000000 | (r << 16) | (g << 8) | b;
+			gpu->rgb16[e][i] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+		}
+	}
+}
+
 gpu_t *gpu_new(nes_t *nes, mem_t *mem)
 {
 	gpu_t *gpu = calloc(sizeof(*gpu), 1);
@@ -13,6 +60,10 @@ gpu_t *gpu_new(nes_t *nes, mem_t *mem)
 		return NULL;
 	gpu->nes = nes;
 	gpu->mem = mem;
+	gpu->hit_clock = UINT64_MAX;
+	gpu->overflow_clock = UINT64_MAX;
+	gpu->pixel = gpu_pixel_get();
+	gpu_init_luts(gpu);
 	return gpu;
 }
 
@@ -23,139 +74,389 @@ void gpu_del(gpu_t *gpu)
 	free(gpu);
 }
 
-static void gpu_cycle(gpu_t *gpu)
+/* buckets every sprite in the lines it covers, once per frame instead of
+ * scanning the oam on each line, it runs at the start of the frame which
+ * also resets the sprite 0 hit and gives the overflow time
+ */
+static void gpu_sprites_eval(gpu_t *gpu)
+{
+	mem_t *mem = gpu->mem;
+	uint8_t height = (mem_get_gpu_reg(mem, MEM_REG_GPU_RC1) & 0x20) ? 16 : 8;
+	memset(gpu->sprite_count, 0, sizeof(gpu->sprite_count));
+	gpu->hit_clock = UINT64_MAX;
+	gpu->overflow_clock = UINT64_MAX;
+	for (uint8_t i = 0; i < 64; ++i)
+	{
+		/* sprites show up on the line after their y */
+		uint16_t top = mem->gpu_oam[i * 4] + 1;
+		for (uint16_t y = top; y < top + height && y < 240; ++y)
+		{
+			if (gpu->sprite_count[y] < 8)
+				gpu->sprites[y][gpu->sprite_count[y]++] = i;
+			else
+				gpu->sprite_count[y] = 9;
+		}
+	}
+	if (!(mem_get_gpu_reg(mem, MEM_REG_GPU_RC2) & 0x18))
+		return;
+	for (uint16_t y = 0; y < 240; ++y)
+	{
+		if (gpu->sprite_count[y] > 8)
+		{
+			gpu->overflow_clock = gpu->clock
+			                    + y * GPU_LINE_DOTS * GPU_CLOCK_DIVIDER;
+			break;
+		}
+	}
+}
+
+/* builds the sprite pixels of the line: bits 0-4 are the palette index,
+ * 0x40 puts the pixel behind the background and 0x80 marks sprite 0
+ * lower oam indexes come first and win over the later ones
+ */
+static void gpu_sprites_line(gpu_t *gpu)
 {
-	if (gpu->x < 256 && gpu->y < 240)
-	{
-		uint8_t bx = gpu->x / 8;
-		uint8_t by = gpu->y / 8;
-		uint8_t px = gpu->x % 8;
-		uint8_t py = gpu->y % 8;
-		uint16_t chr = mem_gpu_get(gpu->mem, 0x2000 + bx + by * 32);
-		uint8_t palid = mem_gpu_get(gpu->mem, 0x23C0 + bx / 4 + by / 4 * 8);
-		uint8_t pals = (bx & 2) + ((by & 2) << 1);
-		palid = (palid >> pals) & 0x3;
-		uint16_t addr = (chr * 16) & 0xFFF;
-		if (mem_get_gpu_reg(gpu->mem, MEM_REG_GPU_RC1) & 0x10)
-			addr += 0x1000;
-		uint8_t v1 = mem_gpu_get(gpu->mem, addr + py + 0);
-		uint8_t v2 = mem_gpu_get(gpu->mem, addr + py + 8);
-		uint8_t v = (((v1 >> (7 - px)) & 1) << 0)
-		          | (((v2 >> (7 - px)) & 1) << 1);
-#if 1
-		if (v)
-			v = mem_gpu_get(gpu->mem, 0x3F00 | (palid << 2) | v);
+	mem_t *mem = gpu->mem;
+	uint8_t rc1 = mem_get_gpu_reg(mem, MEM_REG_GPU_RC1);
+	uint8_t rc2 = mem_get_gpu_reg(mem, MEM_REG_GPU_RC2);
+	uint8_t count = gpu->sprite_count[gpu->y];
+	memset(gpu->sprite_line, 0, sizeof(gpu->sprite_line));
+	if (!(rc2 & 0x10))
+		return;
+	if (count > 8)
+		count = 8;
+	uint8_t height = (rc1 & 0x20) ? 16 : 8;
+	uint8_t first = (rc2 & 0x04) ? 0 : 8;
+	for (uint8_t i = 0; i < count; ++i)
+	{
+		uint8_t n = gpu->sprites[gpu->y][i];
+		const uint8_t *oam = &mem->gpu_oam[n * 4];
+		uint8_t row = gpu->y - oam[0] - 1;
+		uint8_t attr = oam[2];
+		if (attr & 0x80)
+			row = height - 1 - row;
+		uint16_t addr;
+		if (height == 16)
+			addr = ((oam[1] & 1) << 12) | ((oam[1] & 0xFE) << 4);
 		else
-			v = mem_gpu_get(gpu->mem, 0x3F00);
-#else
-		v = chr;
-#endif
-		static const uint8_t colors[3 * 0x40] =
+			addr = ((rc1 & 0x08) << 9) | (oam[1] << 4);
+		if (row >= 8)
+			addr += 16;
+		const uint8_t *src = mbc_chr_tile(mem->mbc, addr, attr & 0x40)
+		                   + (row & 7) * 8;
+		uint8_t flags = 0x10 | ((attr & 0x3) << 2)
+		              | ((attr & 0x20) ? 0x40 : 0)
+		              | (n ? 0 : 0x80);
+		for (uint8_t x = 0; x < 8; ++x)
 		{
-			124,124,124,
-			0,0,252,
-			0,0,188,
-			68,40,188,
-			148,0,132,
-			168,0,32,
-			168,16,0,
-			136,20,0,
-			80,48,0,
-			0,120,0,
-			0,104,0,
-			0,88,0,
-			0,64,88,
-			0,0,0,
-			0,0,0,
-			0,0,0,
-			188,188,188,
-			0,120,248,
-			0,88,248,
-			104,68,252,
-			216,0,204,
-			228,0,88,
-			248,56,0,
-			228,92,16,
-			172,124,0,
-			0,184,0,
-			0,168,0,
-			0,168,68,
-			0,136,136,
-			0,0,0,
-			0,0,0,
-			0,0,0,
-			248,248,248,
-			60,188,252,
-			104,136,252,
-			152,120,248,
-			248,120,248,
-			248,88,152,
-			248,120,88,
-			252,160,68,
-			248,184,0,
-			184,248,24,
-			88,216,84,
-			88,248,152,
-			0,232,216,
-			120,120,120,
-			0,0,0,
-			0,0,0,
-			252,252,252,
-			164,228,252,
-			184,184,248,
-			216,184,248,
-			248,184,248,
-			248,164,192,
-			240,208,176,
-			252,224,168,
-			248,216,120,
-			216,248,120,
-			184,248,184,
-			184,248,216,
-			0,252,252,
-			248,216,248,
-			0,0,0,
-			0,0,0,
-		};
-		uint32_t idx = (gpu->x + gpu->y * 256) * 4;
-#if 1
-		uint8_t col = 3 * (v & 0x3F);
-		gpu->data[idx + 0] = colors[col + 0];
-		gpu->data[idx + 1] = colors[col + 1];
-		gpu->data[idx + 2] = colors[col + 2];
-#else
-		gpu->data[idx + 0] = v;
-		gpu->data[idx + 1] = v;
-		gpu->data[idx + 2] = v;
-#endif
-		gpu->data[idx + 3] = 0xff;
-	}
-	gpu->x++;
-	if (gpu->x == 341)
-	{
-		gpu->x = 0;
-		gpu->y++;
-		if (gpu->y == 240)
+			uint16_t dx = oam[3] + x;
+			if (dx >= 256)
+				break;
+			if (!src[x] || dx < first || gpu->sprite_line[dx])
+				continue;
+			gpu->sprite_line[dx] = flags | src[x];
+		}
+	}
+}
+
+/* coarse x of the vram address, wrapping into the next nametable */
+static uint16_t gpu_inc_x(uint16_t v)
+{
+	if ((v & 0x001F) == 0x001F)
+		return (v & ~0x001F) ^ 0x0400;
+	return v + 1;
+}
+
+/* fine y then coarse y of the vram address, row 29 wraps into the next
+ * nametable while rows 30 and 31 (attributes) wrap in place
+ */
+static uint16_t gpu_inc_y(uint16_t v)
+{
+	if ((v & 0x7000) != 0x7000)
+		return v + 0x1000;
+	v &= ~0x7000;
+	uint16_t y = (v & 0x03E0) >> 5;
+	if (y == 29)
+	{
+		y = 0;
+		v ^= 0x0800;
+	}
+	else if (y == 31)
+	{
+		y = 0;
+	}
+	else
+	{
+		y++;
+	}
+	return (v & ~0x03E0) | (y << 5);
+}
+
+/* draws dots [x0, x1) of the current line: every tile touched by the span is
+ * fetched once and its decoded row copied with the attribute bits on top
+ * the vram address holds the tile of dot x0 and is moved past the span, so a
+ * mid-line write picks up at the dot it landed on
+ */
+static void gpu_render(gpu_t *gpu, uint16_t x0, uint16_t x1)
+{
+	mem_t *mem = gpu->mem;
+	uint8_t rc1 = mem_get_gpu_reg(mem, MEM_REG_GPU_RC1);
+	uint8_t rc2 = mem_get_gpu_reg(mem, MEM_REG_GPU_RC2);
+	uint8_t line[256 + 16];
+	uint16_t fine_x = mem->fine_x;
+	uint16_t first = (x0 + fine_x) / 8;
+	if (rc2 & 0x08)
+	{
+		uint16_t pattern = (rc1 & 0x10) ? 0x1000 : 0x0000;
+		uint16_t last = (x1 - 1 + fine_x) / 8;
+		uint16_t v = mem->vram_addr;
+		uint8_t *dst = &line[first * 8];
+		for (uint16_t tile = first; tile <= last; ++tile, dst += 8)
 		{
-			if (mem_get_gpu_reg(gpu->mem, MEM_REG_GPU_RC1) & 0x80)
-				cpu_nmi(gpu->nes->cpu);
+			uint8_t chr = mem_gpu_get(mem, 0x2000 | (v & 0x0FFF));
+			uint8_t attr = mem_gpu_get(mem, 0x23C0 | (v & 0x0C00)
+			                              | ((v >> 4) & 0x38)
+			                              | ((v >> 2) & 0x07));
+			attr = ((attr >> ((v & 2) | ((v >> 4) & 4))) & 0x3) << 2;
+			const uint8_t *row = mbc_chr_tile(mem->mbc, pattern | (chr << 4), 0)
+			                   + (v >> 12) * 8;
+			memcpy(dst, row, 8);
+			for (uint8_t i = 0; i < 8; ++i)
+				dst[i] |= attr;
+			v = gpu_inc_x(v);
 		}
-		if (gpu->y == 262)
+		if (!(rc2 & 0x02))
 		{
-			gpu->y = 0;
+			for (uint16_t x = x0; x < x1 && x < 8; ++x)
+				line[x + fine_x] = 0;
 		}
+		/* the line buffer is indexed from the first fetched tile */
+		memmove(&line[x0], &line[x0 + fine_x], x1 - x0);
 	}
-	if (gpu->y >= 240)
-		mem_set_gpu_reg(gpu->mem, MEM_REG_GPU_STATUS, 0x80);
 	else
-		mem_set_gpu_reg(gpu->mem, MEM_REG_GPU_STATUS, 0x00);
+	{
+		memset(&line[x0], 0, x1 - x0);
+	}
+	if (rc2 & 0x18)
+	{
+		for (uint16_t tile = first; tile < (x1 + fine_x) / 8; ++tile)
+			mem->vram_addr = gpu_inc_x(mem->vram_addr);
+	}
+	/* sprites go over the background unless they are behind it and the
+	 * background pixel is opaque, sprite 0 hits on opaque over opaque
+	 */
+	uint16_t hit = 256;
+	for (uint16_t x = x0; x < x1; ++x)
+	{
+		uint8_t s = gpu->sprite_line[x];
+		if (!s)
+			continue;
+		if (line[x] & 0x3)
+		{
+			/* no hit on the last dot */
+			if ((s & 0x80) && x != 255 && hit == 256)
+				hit = x;
+			if (s & 0x40)
+				continue;
+		}
+		line[x] = s & 0x1F;
+	}
+	if (hit != 256 && gpu->hit_clock == UINT64_MAX)
+		gpu->hit_clock = gpu->clock + (hit - x0) * GPU_CLOCK_DIVIDER;
+	/* pixel 0 of every palette shows the backdrop */
+	uint8_t lut[0x20];
+	uint8_t mask = (rc2 & 0x01) ? 0x30 : 0x3F;
+	for (uint8_t i = 0; i < 0x20; ++i)
+		lut[i] = mem->gpu_palettes[(i & 3) ? i : 0] & mask;
+	gpu->pixel->index(&gpu->data[gpu->y * 256 + x0], &line[x0], x1 - x0, lut);
+	gpu->emphasis[gpu->y] = rc2 >> 5;
+}
+
+/* the gpu only runs when observed: on register accesses, mapper writes,
+ * mapper irqs and at the end of the frame, one call covers as many lines as
+ * needed
+ */
+void gpu_sync(gpu_t *gpu, uint64_t clock)
+{
+	while (clock >= gpu->clock + GPU_CLOCK_DIVIDER)
+	{
+		uint64_t dots = (clock - gpu->clock) / GPU_CLOCK_DIVIDER;
+		uint16_t end = gpu->x + dots > GPU_LINE_DOTS ? GPU_LINE_DOTS
+		                                             : gpu->x + dots;
+		if (!gpu->x && !gpu->y)
+			gpu_sprites_eval(gpu);
+		if (!gpu->x && gpu->y < 240)
+			gpu_sprites_line(gpu);
+		if (gpu->y < 240 && gpu->x < 256)
+			gpu_render(gpu, gpu->x, end < 256 ? end : 256);
+		/* the vertical scroll steps at dot 256, the horizontal one is reloaded
+		 * at dot 257 and the pre-render line reloads the vertical one
+		 */
+		if (gpu->x <= 256 && end > 256
+		 && (gpu->y < 240 || gpu->y == GPU_LINE_COUNT - 1)
+		 && (mem_get_gpu_reg(gpu->mem, MEM_REG_GPU_RC2) & 0x18))
+		{
+			mem_t *mem = gpu->mem;
+			uint16_t v = gpu_inc_y(mem->vram_addr);
+			v = (v & ~0x041F) | (mem->vram_tmp & 0x041F);
+			if (gpu->y == GPU_LINE_COUNT - 1)
+				v = (v & ~0x7BE0) | (mem->vram_tmp & 0x7BE0);
+			mem->vram_addr = v;
+		}
+		/* XXX approximates the a12 rise of the sprite fetches */
+		if (gpu->x <= 260 && end > 260
+		 && (gpu->y < 240 || gpu->y == GPU_LINE_COUNT - 1)
+		 && (mem_get_gpu_reg(gpu->mem, MEM_REG_GPU_RC2) & 0x18))
+			mbc_scanline(gpu->mem->mbc);
+		gpu->clock += (end - gpu->x) * GPU_CLOCK_DIVIDER;
+		gpu->x = end;
+		if (gpu->x == GPU_LINE_DOTS)
+		{
+			gpu->x = 0;
+			gpu->y++;
+			if (gpu->y == GPU_LINE_COUNT)
+				gpu->y = 0;
+		}
+	}
+}
+
+/* register writes land at the cpu position inside its current slice */
+void gpu_catchup(gpu_t *gpu)
+{
+	gpu_sync(gpu, gpu->nes->cpu->cycles * CPU_CLOCK_DIVIDER);
+}
+
+/* $2002 is built from the timestamps of its flags instead of being stored
+ * on every change: vblank spans lines 240 to 260 unless a read already
+ * cleared it, sprite 0 hit and overflow last until the pre-render line
+ * the gpu only runs when the answer depends on it: to evaluate the sprites
+ * at the start of the frame and through the lines sprite 0 can hit on
+ */
+uint8_t gpu_status(gpu_t *gpu)
+{
+	mem_t *mem = gpu->mem;
+	uint64_t clock = gpu->nes->cpu->cycles * CPU_CLOCK_DIVIDER;
+	uint64_t frame = clock - clock % NES_FRAME_CLOCKS;
+	uint64_t line_clocks = GPU_LINE_DOTS * GPU_CLOCK_DIVIDER;
+	uint64_t line = (clock - frame) / line_clocks;
+	if (gpu->clock <= frame)
+		gpu_sync(gpu, frame + GPU_CLOCK_DIVIDER);
+	if (gpu->hit_clock == UINT64_MAX)
+	{
+		uint8_t height = (mem_get_gpu_reg(mem, MEM_REG_GPU_RC1) & 0x20) ? 16
+		                                                                : 8;
+		uint64_t top = mem->gpu_oam[0] + 1;
+		uint64_t bottom = top + height < 240 ? top + height : 240;
+		uint64_t end = frame + bottom * line_clocks;
+		if (top < 240 && clock >= frame + top * line_clocks
+		 && gpu->clock < end)
+			gpu_sync(gpu, clock < end ? clock : end);
+	}
+	uint8_t status = 0;
+	if (line >= 240 && line < GPU_LINE_COUNT - 1)
+	{
+		if (gpu->vblank_clear < frame + 240 * line_clocks)
+			status |= 0x80;
+		gpu->vblank_clear = clock;
+	}
+	uint64_t clear = line < GPU_LINE_COUNT - 1
+	               ? frame - line_clocks
+	               : frame + (GPU_LINE_COUNT - 1) * line_clocks;
+	if (gpu->hit_clock >= clear && gpu->hit_clock <= clock)
+		status |= 0x40;
+	if (gpu->overflow_clock >= clear && gpu->overflow_clock <= clock)
+		status |= 0x20;
+	return status;
+}
+
+/* earliest clock after clock and before until at which $2002 can read
+ * differently, a sprite 0 hit that isn't known yet can happen anywhere in
+ * the lines of sprite 0
+ */
+uint64_t gpu_status_next(gpu_t *gpu, uint64_t clock, uint64_t until)
+{
+	mem_t *mem = gpu->mem;
+	uint64_t frame = clock - clock % NES_FRAME_CLOCKS;
+	uint64_t line_clocks = GPU_LINE_DOTS * GPU_CLOCK_DIVIDER;
+	uint64_t next = frame + 240 * line_clocks;
+	if (next <= clock)
+		next = frame + (GPU_LINE_COUNT - 1) * line_clocks;
+	if (next <= clock)
+		next = frame + NES_FRAME_CLOCKS;
+	if (next > until)
+		next = until;
+	if (gpu->clock <= frame)
+		gpu_sync(gpu, frame + GPU_CLOCK_DIVIDER);
+	if (gpu->hit_clock == UINT64_MAX)
+	{
+		uint8_t height = (mem_get_gpu_reg(mem, MEM_REG_GPU_RC1) & 0x20) ? 16
+		                                                                : 8;
+		uint64_t top = mem->gpu_oam[0] + 1;
+		uint64_t bottom = top + height < 240 ? top + height : 240;
+		uint64_t start = frame + top * line_clocks;
+		if (top < 240 && start < next && clock < frame + bottom * line_clocks)
+			next = start > clock ? start : clock;
+	}
+	if (gpu->hit_clock > clock && gpu->hit_clock < next)
+		next = gpu->hit_clock;
+	if (gpu->overflow_clock > clock && gpu->overflow_clock < next)
+		next = gpu->overflow_clock;
+	return next;
+}
+
+/* the mapper irq fires on a scanline clock, which happens at dot 260 of the
+ * rendered lines as long as rendering is enabled, the event is placed on
+ * the dot where the sync reaches it
+ */
+void gpu_schedule(gpu_t *gpu)
+{
+	sched_t *sched = gpu->nes->sched;
+	int n = mbc_irq(gpu->mem->mbc);
+	if (n <= 0 || !(mem_get_gpu_reg(gpu->mem, MEM_REG_GPU_RC2) & 0x18))
+	{
+		sched_set(sched, SCHED_MBC_IRQ, SCHED_NEVER);
+		return;
+	}
+	uint64_t clock = gpu->clock - gpu->x * GPU_CLOCK_DIVIDER;
+	uint16_t y = gpu->y;
+	if (gpu->x > 260)
+	{
+		clock += GPU_LINE_DOTS * GPU_CLOCK_DIVIDER;
+		y = (y + 1) % GPU_LINE_COUNT;
+	}
+	while (1)
+	{
+		if ((y < 240 || y == GPU_LINE_COUNT - 1) && !--n)
+			break;
+		clock += GPU_LINE_DOTS * GPU_CLOCK_DIVIDER;
+		y = (y + 1) % GPU_LINE_COUNT;
+	}
+	sched_set(sched, SCHED_MBC_IRQ, clock + 261 * GPU_CLOCK_DIVIDER);
 }
 
-void gpu_clock(gpu_t *gpu)
+/* runs of lines sharing their emphasis are converted in one kernel call */
+void gpu_convert(gpu_t *gpu, void *dst, size_t pitch, enum gpu_format format)
 {
-	if (++gpu->clock_count == 4) /* 5 in PAL */
+	if (format == GPU_FORMAT_INDEX)
 	{
-		gpu_cycle(gpu);
-		gpu->clock_count = 0;
+		for (size_t y = 0; y < 240; ++y)
+			memcpy((uint8_t*)dst + y * pitch, &gpu->data[y * 256], 256);
+		return;
+	}
+	size_t y = 0;
+	while (y < 240)
+	{
+		uint8_t emphasis = gpu->emphasis[y];
+		size_t n = 1;
+		while (y + n < 240 && gpu->emphasis[y + n] == emphasis)
+			n++;
+		uint8_t *out = (uint8_t*)dst + y * pitch;
+		if (format == GPU_FORMAT_RGB565)
+			gpu->pixel->rgb16(out, pitch, &gpu->data[y * 256], 256, n,
+			                  gpu->rgb16[emphasis]);
+		else
+			gpu->pixel->rgb32(out, pitch, &gpu->data[y * 256], 256, n,
+			                  gpu->rgb32[emphasis]);
+		y += n;
 	}
 }
@@ -1,23 +1,51 @@
 #ifndef GPU_H
 #define GPU_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+#define GPU_CLOCK_DIVIDER 4 /* 5 in PAL */
+#define GPU_LINE_DOTS     341
+#define GPU_LINE_COUNT    262 /* 312 in PAL */
+
+enum gpu_format
+{
+	GPU_FORMAT_XRGB8888,
+	GPU_FORMAT_RGB565,
+	GPU_FORMAT_INDEX,
+};
+
 typedef struct mem mem_t;
 typedef struct nes nes_t;
+typedef struct gpu_pixel gpu_pixel_t;
 
 typedef struct gpu
 {
 	nes_t *nes;
 	mem_t *mem;
-	uint8_t data[256 * 240 * 4];
-	uint8_t clock_count;
+	const gpu_pixel_t *pixel; /* kernels picked for the host */
+	uint8_t data[256 * 240]; /* 6-bit colours */
+	uint8_t emphasis[240]; /* rc2 bits 5-7 of each line */
+	uint8_t sprite_count[240]; /* 9 when the line overflowed */
+	uint8_t sprites[240][8]; /* oam indexes of the sprites of each line */
+	uint8_t sprite_line[256]; /* sprite pixels of the current line */
+	uint32_t rgb32[8][64];
+	uint16_t rgb16[8][64];
+	uint64_t clock;
+	uint64_t hit_clock; /* sprite 0 hit of the frame, UINT64_MAX if none */
+	uint64_t overflow_clock;
+	uint64_t vblank_clear; /* last $2002 read */
 	uint16_t x;
 	uint16_t y;
 } gpu_t;
 
 gpu_t *gpu_new(nes_t *nes, mem_t *mem);
 void gpu_del(gpu_t *gpu);
-void gpu_clock(gpu_t *gpu);
+void gpu_sync(gpu_t *gpu, uint64_t clock);
+void gpu_catchup(gpu_t *gpu);
+uint8_t gpu_status(gpu_t *gpu);
+uint64_t gpu_status_next(gpu_t *gpu, uint64_t clock, uint64_t until);
+void gpu_schedule(gpu_t *gpu);
+void gpu_convert(gpu_t *gpu, void *dst, size_t pitch, enum gpu_format format);
 
 #endif
@@ -0,0 +1,315 @@
+#include "pixel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define GPU_PIXEL_X86
+# include <immintrin.h>
+#endif
+
+static void index_scalar(uint8_t *dst, const uint8_t *src, size_t count,
+                         const uint8_t *lut)
+{
+	for (size_t i = 0; i < count; ++i)
+		dst[i] = lut[src[i] & 0x1F];
+}
+
+static void rgb32_scalar(void *dst, size_t pitch, const uint8_t *src,
+                         size_t width, size_t height, const uint32_t *lut)
+{
+	for (size_t y = 0; y < height; ++y, src += width)
+	{
+		uint32_t *line = (uint32_t*)((uint8_t*)dst + y * pitch);
+		for (size_t x = 0; x < width; ++x)
+			line[x] = lut[src[x] & 0x3F];
+	}
+}
+
+static void rgb16_scalar(void *dst, size_t pitch, const uint8_t *src,
+                         size_t width, size_t height, const uint16_t *lut)
+{
+	for (size_t y = 0; y < height; ++y, src += width)
+	{
+		uint16_t *line = (uint16_t*)((uint8_t*)dst + y * pitch);
+		for (size_t x = 0; x < width; ++x)
+			line[x] = lut[src[x] & 0x3F];
+	}
+}
+
+#ifdef GPU_PIXEL_X86
+
+/* luts are split in one table per output byte, each made of 16 entries
+ * pshufb blocks picked by the index bits 4-5, the byte planes are then
+ * interleaved back into pixels
+ */
+__attribute__((target("ssse3")))
+static inline __m128i lookup_ssse3(const __m128i *tables, uint8_t count,
+                                   __m128i idx)
+{
+	__m128i lo = _mm_and_si128(idx, _mm_set1_epi8(0x0F));
+	__m128i hi = _mm_and_si128(idx, _mm_set1_epi8(0x30));
+	__m128i ret = _mm_shuffle_epi8(tables[0], lo);
+	for (uint8_t i = 1; i < count; ++i)
+	{
+		__m128i sel = _mm_cmpeq_epi8(hi, _mm_set1_epi8(i << 4));
+		__m128i v = _mm_shuffle_epi8(tables[i], lo);
+		ret = _mm_or_si128(_mm_andnot_si128(sel, ret), _mm_and_si128(sel, v));
+	}
+	return ret;
+}
+
+__attribute__((target("ssse3")))
+static void index_ssse3(uint8_t *dst, const uint8_t *src, size_t count,
+                        const uint8_t *lut)
+{
+	__m128i tables[2];
+	tables[0] = _mm_loadu_si128((const __m128i*)&lut[0]);
+	tables[1] = _mm_loadu_si128((const __m128i*)&lut[16]);
+	const __m128i mask = _mm_set1_epi8(0x1F);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i idx = _mm_loadu_si128((const __m128i*)&src[i]);
+		idx = _mm_and_si128(idx, mask);
+		_mm_storeu_si128((__m128i*)&dst[i], lookup_ssse3(tables, 2, idx));
+	}
+	index_scalar(&dst[i], &src[i], count - i, lut);
+}
+
+__attribute__((target("ssse3")))
+static void rgb32_ssse3(void *dst, size_t pitch, const uint8_t *src,
+                        size_t width, size_t height, const uint32_t *lut)
+{
+	uint8_t planes[3][64];
+	for (uint8_t i = 0; i < 64; ++i)
+	{
+		for (uint8_t c = 0; c < 3; ++c)
+			planes[c][i] = lut[i] >> (c * 8);
+	}
+	__m128i tables[3][4];
+	for (uint8_t c = 0; c < 3; ++c)
+	{
+		for (uint8_t i = 0; i < 4; ++i)
+			tables[c][i] = _mm_loadu_si128((const __m128i*)&planes[c][i * 16]);
+	}
+	const __m128i alpha = _mm_set1_epi8((char)(lut[0] >> 24));
+	for (size_t y = 0; y < height; ++y, src += width)
+	{
+		uint32_t *line = (uint32_t*)((uint8_t*)dst + y * pitch);
+		size_t x = 0;
+		for (; x + 16 <= width; x += 16)
+		{
+			__m128i idx = _mm_loadu_si128((const __m128i*)&src[x]);
+			__m128i b = lookup_ssse3(tables[0], 4, idx);
+			__m128i g = lookup_ssse3(tables[1], 4, idx);
+			__m128i r = lookup_ssse3(tables[2], 4, idx);
+			__m128i bg_lo = _mm_unpacklo_epi8(b, g);
+			__m128i bg_hi = _mm_unpackhi_epi8(b, g);
+			__m128i ra_lo = _mm_unpacklo_epi8(r, alpha);
+			__m128i ra_hi = _mm_unpackhi_epi8(r, alpha);
+			__m128i *out = (__m128i*)&line[x];
+			_mm_storeu_si128(&out[0], _mm_unpacklo_epi16(bg_lo, ra_lo));
+			_mm_storeu_si128(&out[1], _mm_unpackhi_epi16(bg_lo, ra_lo));
+			_mm_storeu_si128(&out[2], _mm_unpacklo_epi16(bg_hi, ra_hi));
+			_mm_storeu_si128(&out[3], _mm_unpackhi_epi16(bg_hi, ra_hi));
+		}
+		rgb32_scalar(&line[x], 0, &src[x], width - x, 1, lut);
+	}
+}
+
+__attribute__((target("ssse3")))
+static void rgb16_ssse3(void *dst, size_t pitch, const uint8_t *src,
+                        size_t width, size_t height, const uint16_t *lut)
+{
+	uint8_t planes[2][64];
+	for (uint8_t i = 0; i < 64; ++i)
+	{
+		planes[0][i] = lut[i] >> 0;
+		planes[1][i] = lut[i] >> 8;
+	}
+	__m128i tables[2][4];
+	for (uint8_t c = 0; c < 2; ++c)
+	{
+		for (uint8_t i = 0; i < 4; ++i)
+			tables[c][i] = _mm_loadu_si128((const __m128i*)&planes[c][i * 16]);
+	}
+	for (size_t y = 0; y < height; ++y, src += width)
+	{
+		uint16_t *line = (uint16_t*)((uint8_t*)dst + y * pitch);
+		size_t x = 0;
+		for (; x + 16 <= width; x += 16)
+		{
+			__m128i idx = _mm_loadu_si128((const __m128i*)&src[x]);
+			__m128i lo = lookup_ssse3(tables[0], 4, idx);
+			__m128i hi = lookup_ssse3(tables[1], 4, idx);
+			__m128i *out = (__m128i*)&line[x];
+			_mm_storeu_si128(&out[0], _mm_unpacklo_epi8(lo, hi));
+			_mm_storeu_si128(&out[1], _mm_unpackhi_epi8(lo, hi));
+		}
+		rgb16_scalar(&line[x], 0, &src[x], width - x, 1, lut);
+	}
+}
+
+/* same as ssse3 on 32 pixels, pshufb and unpack work per 128-bit lane so
+ * the tables are broadcast and the halves put back in order on store
+ */
+__attribute__((target("avx2")))
+static inline __m256i lookup_avx2(const __m256i *tables, uint8_t count,
+                                  __m256i idx)
+{
+	__m256i lo = _mm256_and_si256(idx, _mm256_set1_epi8(0x0F));
+	__m256i hi = _mm256_and_si256(idx, _mm256_set1_epi8(0x30));
+	__m256i ret = _mm256_shuffle_epi8(tables[0], lo);
+	for (uint8_t i = 1; i < count; ++i)
+	{
+		__m256i sel = _mm256_cmpeq_epi8(hi, _mm256_set1_epi8(i << 4));
+		__m256i v = _mm256_shuffle_epi8(tables[i], lo);
+		ret = _mm256_blendv_epi8(ret, v, sel);
+	}
+	return ret;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i broadcast_avx2(const uint8_t *data)
+{
+	return _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)data));
+}
+
+__attribute__((target("avx2")))
+static void index_avx2(uint8_t *dst, const uint8_t *src, size_t count,
+                       const uint8_t *lut)
+{
+	__m256i tables[2];
+	tables[0] = broadcast_avx2(&lut[0]);
+	tables[1] = broadcast_avx2(&lut[16]);
+	const __m256i mask = _mm256_set1_epi8(0x1F);
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32)
+	{
+		__m256i idx = _mm256_loadu_si256((const __m256i*)&src[i]);
+		idx = _mm256_and_si256(idx, mask);
+		_mm256_storeu_si256((__m256i*)&dst[i], lookup_avx2(tables, 2, idx));
+	}
+	index_ssse3(&dst[i], &src[i], count - i, lut);
+}
+
+__attribute__((target("avx2")))
+static void rgb32_avx2(void *dst, size_t pitch, const uint8_t *src,
+                       size_t width, size_t height, const uint32_t *lut)
+{
+	uint8_t planes[3][64];
+	for (uint8_t i = 0; i < 64; ++i)
+	{
+		for (uint8_t c = 0; c < 3; ++c)
+			planes[c][i] = lut[i] >> (c * 8);
+	}
+	__m256i tables[3][4];
+	for (uint8_t c = 0; c < 3; ++c)
+	{
+		for (uint8_t i = 0; i < 4; ++i)
+			tables[c][i] = broadcast_avx2(&planes[c][i * 16]);
+	}
+	const __m256i alpha = _mm256_set1_epi8((char)(lut[0] >> 24));
+	for (size_t y = 0; y < height; ++y, src += width)
+	{
+		uint32_t *line = (uint32_t*)((uint8_t*)dst + y * pitch);
+		size_t x = 0;
+		for (; x + 32 <= width; x += 32)
+		{
+			__m256i idx = _mm256_loadu_si256((const __m256i*)&src[x]);
+			__m256i b = lookup_avx2(tables[0], 4, idx);
+			__m256i g = lookup_avx2(tables[1], 4, idx);
+			__m256i r = lookup_avx2(tables[2], 4, idx);
+			__m256i bg_lo = _mm256_unpacklo_epi8(b, g);
+			__m256i bg_hi = _mm256_unpackhi_epi8(b, g);
+			__m256i ra_lo = _mm256_unpacklo_epi8(r, alpha);
+			__m256i ra_hi = _mm256_unpackhi_epi8(r, alpha);
+			__m256i r0 = _mm256_unpacklo_epi16(bg_lo, ra_lo);
+			__m256i r1 = _mm256_unpackhi_epi16(bg_lo, ra_lo);
+			__m256i r2 = _mm256_unpacklo_epi16(bg_hi, ra_hi);
+			__m256i r3 = _mm256_unpackhi_epi16(bg_hi, ra_hi);
+			__m256i *out = (__m256i*)&line[x];
+			_mm256_storeu_si256(&out[0], _mm256_permute2x128_si256(r0, r1, 0x20));
+			_mm256_storeu_si256(&out[1], _mm256_permute2x128_si256(r2, r3, 0x20));
+			_mm256_storeu_si256(&out[2], _mm256_permute2x128_si256(r0, r1, 0x31));
+			_mm256_storeu_si256(&out[3], _mm256_permute2x128_si256(r2, r3, 0x31));
+		}
+		rgb32_ssse3(&line[x], 0, &src[x], width - x, 1, lut);
+	}
+}
+
+__attribute__((target("avx2")))
+static void rgb16_avx2(void *dst, size_t pitch, const uint8_t *src,
+                       size_t width, size_t height, const uint16_t *lut)
+{
+	uint8_t planes[2][64];
+	for (uint8_t i = 0; i < 64; ++i)
+	{
+		planes[0][i] = lut[i] >> 0;
+		planes[1][i] = lut[i] >> 8;
+	}
+	__m256i tables[2][4];
+	for (uint8_t c = 0; c < 2; ++c)
+	{
+		for (uint8_t i = 0; i < 4; ++i)
+			tables[c][i] = broadcast_avx2(&planes[c][i * 16]);
+	}
+	for (size_t y = 0; y < height; ++y, src += width)
+	{
+		uint16_t *line = (uint16_t*)((uint8_t*)dst + y * pitch);
+		size_t x = 0;
+		for (; x + 32 <= width; x += 32)
+		{
+			__m256i idx = _mm256_loadu_si256((const __m256i*)&src[x]);
+			__m256i lo = lookup_avx2(tables[0], 4, idx);
+			__m256i hi = lookup_avx2(tables[1], 4, idx);
+			__m256i r0 = _mm256_unpacklo_epi8(lo, hi);
+			__m256i r1 = _mm256_unpackhi_epi8(lo, hi);
+			__m256i *out = (__m256i*)&line[x];
+			_mm256_storeu_si256(&out[0], _mm256_permute2x128_si256(r0, r1, 0x20));
+			_mm256_storeu_si256(&out[1], _mm256_permute2x128_si256(r0, r1, 0x31));
+		}
+		rgb16_ssse3(&line[x], 0, &src[x], width - x, 1, lut);
+	}
+}
+
+#endif
+
+static const gpu_pixel_t pixel_scalar =
+{
+	.index = index_scalar,
+	.rgb32 = rgb32_scalar,
+	.rgb16 = rgb16_scalar,
+};
+
+#ifdef GPU_PIXEL_X86
+
+static const gpu_pixel_t pixel_ssse3 =
+{
+	.index = index_ssse3,
+	.rgb32 = rgb32_ssse3,
+	.rgb16 = rgb16_ssse3,
+};
+
+static const gpu_pixel_t pixel_avx2 =
+{
+	.index = index_avx2,
+	.rgb32 = rgb32_avx2,
+	.rgb16 = rgb16_avx2,
+};
+
+#endif
+
+/* the widest kernels the host supports, the build itself only assumes the
+ * base instruction set, each gpu keeps its own pointer to them so that
+ * nothing shared gets written once cores run
+ */
+const gpu_pixel_t *gpu_pixel_get(void)
+{
+#ifdef GPU_PIXEL_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return &pixel_avx2;
+	if (__builtin_cpu_supports("ssse3"))
+		return &pixel_ssse3;
+#endif
+	return &pixel_scalar;
+}
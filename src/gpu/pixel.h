@@ -0,0 +1,30 @@
+#ifndef GPU_PIXEL_H
+#define GPU_PIXEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* resolves count 5-bit palette ram indexes to colours through a 32 bytes lut */
+typedef void (*gpu_pixel_index_fn_t)(uint8_t *dst, const uint8_t *src,
+                                     size_t count, const uint8_t *lut);
+
+/* converts a width * height block of 6-bit colours through a 64 entries lut,
+ * dst lines are pitch bytes apart and src lines are width bytes apart
+ */
+typedef void (*gpu_pixel_rgb32_fn_t)(void *dst, size_t pitch,
+                                     const uint8_t *src, size_t width,
+                                     size_t height, const uint32_t *lut);
+typedef void (*gpu_pixel_rgb16_fn_t)(void *dst, size_t pitch,
+                                     const uint8_t *src, size_t width,
+                                     size_t height, const uint16_t *lut);
+
+typedef struct gpu_pixel
+{
+	gpu_pixel_index_fn_t index;
+	gpu_pixel_rgb32_fn_t rgb32;
+	gpu_pixel_rgb16_fn_t rgb16;
+} gpu_pixel_t;
+
+const gpu_pixel_t *gpu_pixel_get(void);
+
+#endif
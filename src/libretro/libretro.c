@@ -12,10 +12,10 @@
 #define VIDEO_HEIGHT 240
 #define VIDEO_PIXELS VIDEO_WIDTH * VIDEO_HEIGHT
 
-#define VIDEO_FPS (60) /* 50 in PAL */
+#define VIDEO_FPS NES_FPS
 #define AUDIO_FPS (48000)
 
-#define AUDIO_FRAME (800) /* 960 in PAL */ /* ceil(AUDIO_FPS / VIDEO_FPS) */
+#define AUDIO_FRAME 2048 /* room for a frame at 96kHz and more */
 
 static struct retro_log_callback logging;
 static retro_log_printf_t log_cb;
@@ -132,11 +132,12 @@ void retro_reset(void)
 }
 
 static uint8_t video_buf[VIDEO_WIDTH * VIDEO_HEIGHT * 4];
+static enum retro_pixel_format video_format;
 static int16_t audio_buf[AUDIO_FRAME * 2];
 
 void retro_run(void)
 {
-	int16_t tmp_audio[960];
+	int16_t tmp_audio[AUDIO_FRAME];
 	uint32_t joypad = 0;
 
 	input_poll_cb();
@@ -150,21 +151,34 @@ void retro_run(void)
 	joypad |= NES_BUTTON_START  * (!!input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_START));
 	joypad |= NES_BUTTON_SELECT * (!!input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_SELECT));
 
-	nes_frame(g_nes, video_buf, tmp_audio, joypad);
+	/* render straight into the frontend buffer when it lends one */
+	struct retro_framebuffer fb;
+	memset(&fb, 0, sizeof(fb));
+	fb.width = VIDEO_WIDTH;
+	fb.height = VIDEO_HEIGHT;
+	fb.access_flags = RETRO_MEMORY_ACCESS_WRITE;
+	if (!environ_cb(RETRO_ENVIRONMENT_GET_CURRENT_SOFTWARE_FRAMEBUFFER, &fb)
+	 || fb.format != video_format || !fb.data)
+	{
+		fb.data = video_buf;
+		fb.pitch = VIDEO_WIDTH * (video_format == RETRO_PIXEL_FORMAT_RGB565 ? 2 : 4);
+	}
 
-	video_cb(video_buf, VIDEO_WIDTH, VIDEO_HEIGHT, VIDEO_WIDTH * 4);
+	enum nes_video_format format = NES_VIDEO_XRGB8888;
+	if (video_format == RETRO_PIXEL_FORMAT_RGB565)
+		format = NES_VIDEO_RGB565;
+	size_t samples = nes_frame(g_nes, fb.data, fb.pitch, format, tmp_audio,
+	                           AUDIO_FRAME, joypad);
 
-	for (size_t i = 0; i < AUDIO_FRAME; ++i)
+	video_cb(fb.data, VIDEO_WIDTH, VIDEO_HEIGHT, fb.pitch);
+
+	for (size_t i = 0; i < samples; ++i)
 	{
-		uint16_t dst = i * 960 / AUDIO_FRAME;
-		uint16_t sample = tmp_audio[dst];
-		uint8_t l = sample >> 8;
-		uint8_t r = sample >> 0;
-		audio_buf[i * 2 + 0] = (l >> 1) | (l << 7);
-		audio_buf[i * 2 + 1] = (r >> 1) | (r << 7);
+		audio_buf[i * 2 + 0] = tmp_audio[i];
+		audio_buf[i * 2 + 1] = tmp_audio[i];
 	}
 
-	audio_batch_cb(audio_buf, AUDIO_FRAME);
+	audio_batch_cb(audio_buf, samples);
 }
 
 bool retro_load_game(const struct retro_game_info *info)
@@ -184,11 +198,16 @@ bool retro_load_game(const struct retro_game_info *info)
 
 	environ_cb(RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS, desc);
 
-	enum retro_pixel_format fmt = RETRO_PIXEL_FORMAT_XRGB8888;
-	if (!environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt))
+	video_format = RETRO_PIXEL_FORMAT_XRGB8888;
+	if (!environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &video_format))
 	{
 		log_cb(RETRO_LOG_INFO, "XRGB8888 is not supported.\n");
-		return false;
+		video_format = RETRO_PIXEL_FORMAT_RGB565;
+		if (!environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &video_format))
+		{
+			log_cb(RETRO_LOG_INFO, "RGB565 is not supported.\n");
+			return false;
+		}
 	}
 
 	if (info->data == NULL || info->size == 0)
@@ -204,6 +223,7 @@ bool retro_load_game(const struct retro_game_info *info)
 		log_cb(RETRO_LOG_ERROR, "can't create nes\n");
 		return false;
 	}
+	nes_set_audio_rate(g_nes, AUDIO_FPS);
 
 	return true;
 }
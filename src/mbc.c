@@ -1,9 +1,78 @@
 #include "mbc.h"
+#include "mem.h"
+#include "cpu.h"
 #include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+static const mbc_mapper_t mmc0_mapper;
+static const mbc_mapper_t mmc1_mapper;
+static const mbc_mapper_t uxrom_mapper;
+static const mbc_mapper_t cnrom_mapper;
+static const mbc_mapper_t mmc3_mapper;
+static const mbc_mapper_t axrom_mapper;
+
+static const mbc_mapper_t *mappers[] =
+{
+	&mmc0_mapper,
+	&mmc1_mapper,
+	&uxrom_mapper,
+	&cnrom_mapper,
+	&mmc3_mapper,
+	&axrom_mapper,
+};
+
+static int ines_is_nes2(const struct ines *ines)
+{
+	return (ines->flags7 & 0x0C) == 0x08;
+}
+
+/* archaic iNES dumps often carry garbage ("DiskDude!") in bytes 7 to 15,
+ * only trust flags7 when the trailing bytes are zeroed
+ */
+static int ines_has_flags7(const struct ines *ines)
+{
+	if (ines_is_nes2(ines))
+		return 1;
+	return (ines->flags7 & 0x0C) == 0
+	    && !ines->timing && !ines->ext_type
+	    && !ines->misc_roms && !ines->ded;
+}
+
+static uint16_t ines_mapper(const struct ines *ines, uint8_t *submapper)
+{
+	uint16_t mapper = ines->flags6 >> 4;
+	*submapper = 0;
+	if (ines_has_flags7(ines))
+		mapper |= ines->flags7 & 0xF0;
+	if (ines_is_nes2(ines))
+	{
+		mapper |= (uint16_t)(ines->mapper & 0x0F) << 8;
+		*submapper = ines->mapper >> 4;
+	}
+	return mapper;
+}
+
+/* NES 2.0 msb nibble of 0xF switches to the exponent-multiplier notation,
+ * which can go way past the file: those sizes come back as SIZE_MAX
+ */
+static size_t ines_rom_size(const struct ines *ines, uint8_t lsb,
+                            uint8_t msb, size_t unit, size_t size)
+{
+	if (!ines_is_nes2(ines))
+		return lsb * unit;
+	if (msb == 0xF)
+	{
+		size_t mul = (lsb & 3) * 2 + 1;
+		if ((lsb >> 2) >= sizeof(size_t) * 8
+		 || ((size_t)1 << (lsb >> 2)) > size / mul)
+			return SIZE_MAX;
+		return ((size_t)1 << (lsb >> 2)) * mul;
+	}
+	return (((size_t)msb << 8) | lsb) * unit;
+}
+
 mbc_t *mbc_new(const void *data, size_t size)
 {
 	mbc_t *mbc = calloc(sizeof(*mbc), 1);
@@ -34,17 +103,72 @@ mbc_t *mbc_new(const void *data, size_t size)
 		mbc->trainer = NULL;
 
 	mbc->prg_rom_data = mbc->trainer ? &mbc->data[528] : &mbc->data[16];
-	mbc->prg_rom_size = 16384 << (mbc->ines->prg_rom_lsb - 1);
-	if (mbc->ines->chr_rom_lsb)
+	mbc->prg_rom_size = ines_rom_size(mbc->ines, mbc->ines->prg_rom_lsb,
+	                                  mbc->ines->prg_chr_rom_msb & 0xF,
+	                                  16384, size);
+	mbc->chr_rom_size = ines_rom_size(mbc->ines, mbc->ines->chr_rom_lsb,
+	                                  mbc->ines->prg_chr_rom_msb >> 4,
+	                                  8192, size);
+	if (mbc->chr_rom_size)
 	{
-		mbc->chr_rom_size = 8192 << (mbc->ines->chr_rom_lsb - 1);
 		mbc->chr_rom_data = &mbc->prg_rom_data[mbc->prg_rom_size];
+		mbc->chr_data = mbc->chr_rom_data;
+		mbc->chr_size = mbc->chr_rom_size;
 	}
 	else
 	{
-		mbc->chr_rom_size = 0;
 		mbc->chr_rom_data = NULL;
+		mbc->chr_data = mbc->chr_ram;
+		mbc->chr_size = sizeof(mbc->chr_ram);
 	}
+	/* each region against what's left, a sum of them could wrap */
+	size_t off = mbc->prg_rom_data - mbc->data;
+	if (off > size || mbc->prg_rom_size > size - off
+	 || mbc->chr_rom_size > size - off - mbc->prg_rom_size)
+	{
+		fprintf(stderr, "truncated iNES rom\n");
+		free(mbc->data);
+		free(mbc);
+		return NULL;
+	}
+	if (mbc->prg_rom_size < 0x2000 || (mbc->prg_rom_size & 0x1FFF))
+	{
+		fprintf(stderr, "invalid prg rom size\n");
+		free(mbc->data);
+		free(mbc);
+		return NULL;
+	}
+	mbc->chr_tiles = malloc(mbc->chr_size / 16 * 128);
+	mbc->chr_dirty = malloc(mbc->chr_size / 16);
+	if (!mbc->chr_tiles || !mbc->chr_dirty)
+	{
+		free(mbc->chr_tiles);
+		free(mbc->chr_dirty);
+		free(mbc->data);
+		free(mbc);
+		return NULL;
+	}
+	memset(mbc->chr_dirty, 1, mbc->chr_size / 16);
+	mbc->mapper_id = ines_mapper(mbc->ines, &mbc->submapper);
+	for (size_t i = 0; i < sizeof(mappers) / sizeof(*mappers); ++i)
+	{
+		if (mappers[i]->id == mbc->mapper_id)
+		{
+			mbc->mapper = mappers[i];
+			break;
+		}
+	}
+	if (!mbc->mapper)
+	{
+		fprintf(stderr, "unsupported mapper %" PRIu16 "\n", mbc->mapper_id);
+		free(mbc->chr_tiles);
+		free(mbc->chr_dirty);
+		free(mbc->data);
+		free(mbc);
+		return NULL;
+	}
+	printf("mapper: %" PRIu16 ".%" PRIu8 " (%s)\n", mbc->mapper_id,
+	       mbc->submapper, mbc->mapper->name);
 	printf("prg_rom_size: %" PRIx16 "\n", (uint16_t)mbc->prg_rom_size);
 	printf("prg_rom_data: %" PRIx32 "\n", (uint32_t)(mbc->prg_rom_data - mbc->data));
 	printf("chr_rom_size: %" PRIx16 "\n", (uint16_t)mbc->chr_rom_size);
@@ -56,152 +180,406 @@ void mbc_del(mbc_t *mbc)
 {
 	if (!mbc)
 		return;
+	free(mbc->chr_tiles);
+	free(mbc->chr_dirty);
 	free(mbc->data);
 	free(mbc);
 }
 
-static uint8_t mmc0_get(mbc_t *mbc, uint16_t addr)
+/* each tile is stored as 8x8 2-bit indexes, followed by its mirror image */
+void mbc_chr_decode(mbc_t *mbc, uint32_t tile)
 {
-	if (addr < 0x6000)
-		return 0;
-	if (addr < 0x8000)
-		return 0;
-	if (addr < 0xC000)
+	const uint8_t *src = &mbc->chr_data[tile * 16];
+	uint8_t *dst = &mbc->chr_tiles[tile * 128];
+	for (uint8_t y = 0; y < 8; ++y)
 	{
-		addr -= 0x8000;
-		if (addr >= mbc->prg_rom_size)
-			return 0;
-		return mbc->prg_rom_data[addr];
+		uint8_t lo = src[y + 0];
+		uint8_t hi = src[y + 8];
+		for (uint8_t x = 0; x < 8; ++x)
+		{
+			uint8_t v = ((lo >> (7 - x)) & 1) | (((hi >> (7 - x)) & 1) << 1);
+			dst[y * 8 + x] = v;
+			dst[64 + y * 8 + 7 - x] = v;
+		}
 	}
-	if (mbc->ines->prg_rom_lsb > 1)
-		addr -= 0x8000;
-	else
-		addr -= 0xC000;
-	if (addr >= mbc->prg_rom_size)
-		return 0;
-	return mbc->prg_rom_data[addr];
+	mbc->chr_dirty[tile] = 0;
 }
 
-static void mmc0_set(mbc_t *mbc, uint16_t addr, uint8_t v)
+/* negative banks count from the end of the rom */
+static void map_prg8(mbc_t *mbc, uint8_t slot, int bank)
 {
-	(void)mbc;
-	(void)addr;
-	(void)v;
+	size_t count = mbc->prg_rom_size / 0x2000;
+	bank = ((bank % (int)count) + count) % count;
+	mbc->prg_banks[slot] = &mbc->prg_rom_data[bank * 0x2000];
+	mem_map(mbc->mem, 0x8000 + slot * 0x2000, 0x2000, mbc->prg_banks[slot],
+	        NULL);
 }
 
-static uint8_t mmc0_gpu_get(mbc_t *mbc, uint16_t addr)
+static void map_prg16(mbc_t *mbc, uint8_t slot, int bank)
 {
-	if (addr < 0x2000)
-	{
-		if (addr >= mbc->chr_rom_size)
-			return 0;
-		return mbc->chr_rom_data[addr];
-	}
-	return 0;
+	map_prg8(mbc, slot * 2 + 0, bank * 2 + 0);
+	map_prg8(mbc, slot * 2 + 1, bank * 2 + 1);
+}
+
+static void map_prg32(mbc_t *mbc, int bank)
+{
+	map_prg16(mbc, 0, bank * 2 + 0);
+	map_prg16(mbc, 1, bank * 2 + 1);
+}
+
+static void map_chr1(mbc_t *mbc, uint8_t slot, int bank)
+{
+	size_t count = mbc->chr_size / 0x400;
+	bank = ((bank % (int)count) + count) % count;
+	mbc->chr_banks[slot] = &mbc->chr_data[bank * 0x400];
+	mbc->chr_tile_banks[slot] = bank * 0x40;
+	mem_gpu_map(mbc->mem, slot * 0x400, 0x400, mbc->chr_banks[slot]);
+}
+
+static void map_chr4(mbc_t *mbc, uint8_t slot, int bank)
+{
+	for (uint8_t i = 0; i < 4; ++i)
+		map_chr1(mbc, slot * 4 + i, bank * 4 + i);
 }
 
-static void mmc0_gpu_set(mbc_t *mbc, uint16_t addr, uint8_t v)
+static void map_chr8(mbc_t *mbc, int bank)
+{
+	map_chr4(mbc, 0, bank * 2 + 0);
+	map_chr4(mbc, 1, bank * 2 + 1);
+}
+
+static void map_default(mbc_t *mbc)
+{
+	mem_map(mbc->mem, 0x6000, sizeof(mbc->prg_ram), mbc->prg_ram,
+	        mbc->prg_ram);
+	map_prg32(mbc, 0);
+	map_chr8(mbc, 0);
+	if (mbc->ines->flags6 & (1 << 3))
+		mem_gpu_mirror(mbc->mem, MEM_MIRROR_FOUR);
+	else if (mbc->ines->flags6 & (1 << 0))
+		mem_gpu_mirror(mbc->mem, MEM_MIRROR_VERTICAL);
+	else
+		mem_gpu_mirror(mbc->mem, MEM_MIRROR_HORIZONTAL);
+}
+
+static uint8_t open_get(mbc_t *mbc, uint16_t addr)
 {
 	(void)mbc;
 	(void)addr;
-	(void)v;
+	return 0;
 }
 
-static uint8_t mmc1_get(mbc_t *mbc, uint16_t addr)
+static uint8_t chr_gpu_get(mbc_t *mbc, uint16_t addr)
 {
-	if (addr < 0x6000)
-		return 0;
-	if (addr < 0x8000)
-		return 0; /* XXX PRG RAM */
-	if (addr < 0xC000)
-	{
-		/* XXX bank */
-		addr -= 0x8000;
-		if (addr >= mbc->prg_rom_size)
-			return 0;
-		return mbc->prg_rom_data[addr];
-	}
-	/* XXX bank */
-	addr -= 0xC000;
-	if (addr >= mbc->prg_rom_size)
-		return 0;
-	return mbc->prg_rom_data[addr];
+	return mbc->chr_banks[addr >> 10][addr & 0x3FF];
 }
 
-static void mmc1_set(mbc_t *mbc, uint16_t addr, uint8_t v)
+/* only chr ram is writable */
+static void chr_gpu_set(mbc_t *mbc, uint16_t addr, uint8_t v)
 {
+	if (mbc->chr_rom_size)
+		return;
+	mbc->chr_banks[addr >> 10][addr & 0x3FF] = v;
+	mbc->chr_dirty[mbc->chr_tile_banks[addr >> 10] + ((addr >> 4) & 0x3F)] = 1;
 }
 
-static uint8_t mmc1_gpu_get(mbc_t *mbc, uint16_t addr)
+static void mmc0_map(mbc_t *mbc)
 {
-	if (addr < 0x2000)
-	{
-		if (addr >= mbc->chr_rom_size)
-			return 0;
-		return mbc->chr_rom_data[addr];
-	}
-	return 0;
+	map_default(mbc);
 }
 
-static void mmc1_gpu_set(mbc_t *mbc, uint16_t addr, uint8_t v)
+static void mmc0_set(mbc_t *mbc, uint16_t addr, uint8_t v)
 {
 	(void)mbc;
 	(void)addr;
 	(void)v;
 }
 
-uint8_t mbc_get(mbc_t *mbc, uint16_t addr)
+static void mmc1_update(mbc_t *mbc)
 {
-	switch (mbc->ines->flags6 >> 4)
+	uint8_t control = mbc->regs[0];
+	static const enum mem_mirror mirrors[4] =
+	{
+		MEM_MIRROR_SINGLE0,
+		MEM_MIRROR_SINGLE1,
+		MEM_MIRROR_VERTICAL,
+		MEM_MIRROR_HORIZONTAL,
+	};
+	mem_gpu_mirror(mbc->mem, mirrors[control & 0x3]);
+	/* SUROM uses the chr0 high bit as the 256KiB prg outer bank */
+	int outer = mbc->prg_rom_size > 0x40000 ? mbc->regs[1] & 0x10 : 0;
+	int prg = mbc->regs[3] & 0x0F;
+	switch ((control >> 2) & 0x3)
 	{
 		case 0:
-			return mmc0_get(mbc, addr);
 		case 1:
-			return mmc1_get(mbc, addr);
-		default:
-			return 0;
+			map_prg32(mbc, (outer | prg) >> 1);
+			break;
+		case 2:
+			map_prg16(mbc, 0, outer);
+			map_prg16(mbc, 1, outer | prg);
+			break;
+		case 3:
+			map_prg16(mbc, 0, outer | prg);
+			map_prg16(mbc, 1, outer | 0x0F);
+			break;
+	}
+	if (control & 0x10)
+	{
+		map_chr4(mbc, 0, mbc->regs[1]);
+		map_chr4(mbc, 1, mbc->regs[2]);
+	}
+	else
+	{
+		map_chr8(mbc, mbc->regs[1] >> 1);
 	}
 }
 
-void mbc_set(mbc_t *mbc, uint16_t addr, uint8_t v)
+static void mmc1_map(mbc_t *mbc)
 {
-	switch (mbc->ines->flags6 >> 4)
+	map_default(mbc);
+	mbc->regs[0] = 0x0C;
+	mbc->shift = 0x10;
+	mmc1_update(mbc);
+}
+
+/* serial port: five writes shift a value in, lsb first, the fifth one
+ * selects the register from its address
+ */
+static void mmc1_set(mbc_t *mbc, uint16_t addr, uint8_t v)
+{
+	if (addr < 0x8000)
+		return;
+	if (v & 0x80)
 	{
-		case 0:
-			mmc0_set(mbc, addr, v);
-			break;
-		case 1:
-			mmc1_set(mbc, addr, v);
-			break;
-		default:
-			return;
+		mbc->shift = 0x10;
+		mbc->regs[0] |= 0x0C;
+		mmc1_update(mbc);
+		return;
 	}
+	uint8_t full = mbc->shift & 1;
+	mbc->shift = (mbc->shift >> 1) | ((v & 1) << 4);
+	if (!full)
+		return;
+	mbc->regs[(addr >> 13) & 0x3] = mbc->shift;
+	mbc->shift = 0x10;
+	mmc1_update(mbc);
+}
+
+static void uxrom_map(mbc_t *mbc)
+{
+	map_default(mbc);
+	map_prg16(mbc, 0, 0);
+	map_prg16(mbc, 1, -1);
 }
 
-uint8_t mbc_gpu_get(mbc_t *mbc, uint16_t addr)
+static void uxrom_set(mbc_t *mbc, uint16_t addr, uint8_t v)
 {
-	switch (mbc->ines->flags6 >> 4)
+	if (addr < 0x8000)
+		return;
+	map_prg16(mbc, 0, v);
+}
+
+static void cnrom_map(mbc_t *mbc)
+{
+	map_default(mbc);
+}
+
+static void cnrom_set(mbc_t *mbc, uint16_t addr, uint8_t v)
+{
+	if (addr < 0x8000)
+		return;
+	map_chr8(mbc, v);
+}
+
+static void axrom_map(mbc_t *mbc)
+{
+	map_default(mbc);
+	mem_gpu_mirror(mbc->mem, MEM_MIRROR_SINGLE0);
+}
+
+static void axrom_set(mbc_t *mbc, uint16_t addr, uint8_t v)
+{
+	if (addr < 0x8000)
+		return;
+	map_prg32(mbc, v & 0x7);
+	mem_gpu_mirror(mbc->mem, (v & 0x10) ? MEM_MIRROR_SINGLE1
+	                                    : MEM_MIRROR_SINGLE0);
+}
+
+static void mmc3_update(mbc_t *mbc)
+{
+	const uint8_t *r = mbc->regs;
+	if (mbc->ctrl & 0x40)
 	{
-		case 0:
-			return mmc0_gpu_get(mbc, addr);
-		case 1:
-			return mmc1_gpu_get(mbc, addr);
-		default:
-			return 0;
+		map_prg8(mbc, 0, -2);
+		map_prg8(mbc, 2, r[6]);
 	}
+	else
+	{
+		map_prg8(mbc, 0, r[6]);
+		map_prg8(mbc, 2, -2);
+	}
+	map_prg8(mbc, 1, r[7]);
+	map_prg8(mbc, 3, -1);
+	uint8_t inv = (mbc->ctrl & 0x80) ? 4 : 0;
+	map_chr1(mbc, inv ^ 0, r[0] & 0xFE);
+	map_chr1(mbc, inv ^ 1, r[0] | 0x01);
+	map_chr1(mbc, inv ^ 2, r[1] & 0xFE);
+	map_chr1(mbc, inv ^ 3, r[1] | 0x01);
+	map_chr1(mbc, inv ^ 4, r[2]);
+	map_chr1(mbc, inv ^ 5, r[3]);
+	map_chr1(mbc, inv ^ 6, r[4]);
+	map_chr1(mbc, inv ^ 7, r[5]);
 }
 
-void mbc_gpu_set(mbc_t *mbc, uint16_t addr, uint8_t v)
+static void mmc3_map(mbc_t *mbc)
 {
-	switch (mbc->ines->flags6 >> 4)
+	map_default(mbc);
+	mmc3_update(mbc);
+}
+
+static void mmc3_set(mbc_t *mbc, uint16_t addr, uint8_t v)
+{
+	if (addr < 0x8000)
+		return;
+	switch (((addr >> 12) & 0x6) | (addr & 1))
 	{
-		case 0:
-			mmc0_gpu_set(mbc, addr, v);
+		case 0x0:
+			mbc->ctrl = v;
+			mmc3_update(mbc);
 			break;
-		case 1:
-			mmc1_gpu_set(mbc, addr, v);
+		case 0x1:
+			mbc->regs[mbc->ctrl & 0x7] = v;
+			mmc3_update(mbc);
+			break;
+		case 0x2:
+			if (!(mbc->ines->flags6 & (1 << 3)))
+				mem_gpu_mirror(mbc->mem, (v & 1) ? MEM_MIRROR_HORIZONTAL
+				                                 : MEM_MIRROR_VERTICAL);
+			break;
+		case 0x3:
+			/* XXX prg ram protect */
+			break;
+		case 0x4:
+			mbc->irq_latch = v;
+			break;
+		case 0x5:
+			mbc->irq_counter = 0;
+			mbc->irq_reload = 1;
+			break;
+		case 0x6:
+			mbc->irq_enable = 0;
+			cpu_irq_clear(mbc->cpu, CPU_IRQ_MBC);
+			break;
+		case 0x7:
+			mbc->irq_enable = 1;
 			break;
-		default:
-			return;
 	}
 }
+
+static void mmc3_scanline(mbc_t *mbc)
+{
+	if (!mbc->irq_counter || mbc->irq_reload)
+	{
+		mbc->irq_counter = mbc->irq_latch;
+		mbc->irq_reload = 0;
+	}
+	else
+	{
+		mbc->irq_counter--;
+	}
+	if (!mbc->irq_counter && mbc->irq_enable)
+		cpu_irq_set(mbc->cpu, CPU_IRQ_MBC);
+}
+
+static int mmc3_irq(mbc_t *mbc)
+{
+	if (!mbc->irq_enable)
+		return -1;
+	if (!mbc->irq_counter || mbc->irq_reload)
+		return mbc->irq_latch + 1;
+	return mbc->irq_counter;
+}
+
+static const mbc_mapper_t mmc0_mapper =
+{
+	.id = 0,
+	.name = "NROM",
+	.map = mmc0_map,
+	.get = open_get,
+	.set = mmc0_set,
+	.gpu_get = chr_gpu_get,
+	.gpu_set = chr_gpu_set,
+};
+
+static const mbc_mapper_t mmc1_mapper =
+{
+	.id = 1,
+	.name = "MMC1",
+	.map = mmc1_map,
+	.get = open_get,
+	.set = mmc1_set,
+	.gpu_get = chr_gpu_get,
+	.gpu_set = chr_gpu_set,
+};
+
+static const mbc_mapper_t uxrom_mapper =
+{
+	.id = 2,
+	.name = "UxROM",
+	.map = uxrom_map,
+	.get = open_get,
+	.set = uxrom_set,
+	.gpu_get = chr_gpu_get,
+	.gpu_set = chr_gpu_set,
+};
+
+static const mbc_mapper_t cnrom_mapper =
+{
+	.id = 3,
+	.name = "CNROM",
+	.map = cnrom_map,
+	.get = open_get,
+	.set = cnrom_set,
+	.gpu_get = chr_gpu_get,
+	.gpu_set = chr_gpu_set,
+};
+
+static const mbc_mapper_t mmc3_mapper =
+{
+	.id = 4,
+	.name = "MMC3",
+	.map = mmc3_map,
+	.get = open_get,
+	.set = mmc3_set,
+	.gpu_get = chr_gpu_get,
+	.gpu_set = chr_gpu_set,
+	.scanline = mmc3_scanline,
+	.irq = mmc3_irq,
+};
+
+static const mbc_mapper_t axrom_mapper =
+{
+	.id = 7,
+	.name = "AxROM",
+	.map = axrom_map,
+	.get = open_get,
+	.set = axrom_set,
+	.gpu_get = chr_gpu_get,
+	.gpu_set = chr_gpu_set,
+};
+
+size_t mbc_serialize(mbc_t *mbc, void *data, size_t size)
+{
+	if (!mbc->mapper->serialize)
+		return 0;
+	return mbc->mapper->serialize(mbc, data, size);
+}
+
+size_t mbc_unserialize(mbc_t *mbc, const void *data, size_t size)
+{
+	if (!mbc->mapper->unserialize)
+		return 0;
+	return mbc->mapper->unserialize(mbc, data, size);
+}
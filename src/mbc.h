@@ -4,6 +4,9 @@
 #include <stdint.h>
 #include <stddef.h>
 
+typedef struct mem mem_t;
+typedef struct cpu cpu_t;
+
 struct ines
 {
 	uint8_t magic[4];
@@ -21,8 +24,34 @@ struct ines
 	uint8_t ded;
 };
 
-typedef struct mbc
+typedef struct mbc mbc_t;
+
+/* picked once by mbc_new from the iNES mapper number
+ * scanline, irq and (un)serialize are optional: irq returns the number of
+ * scanline clocks left before the mapper raises its irq, or -1
+ */
+typedef struct mbc_mapper
+{
+	uint16_t id;
+	const char *name;
+	void (*map)(mbc_t *mbc);
+	uint8_t (*get)(mbc_t *mbc, uint16_t addr);
+	void (*set)(mbc_t *mbc, uint16_t addr, uint8_t v);
+	uint8_t (*gpu_get)(mbc_t *mbc, uint16_t addr);
+	void (*gpu_set)(mbc_t *mbc, uint16_t addr, uint8_t v);
+	void (*scanline)(mbc_t *mbc);
+	int (*irq)(mbc_t *mbc);
+	size_t (*serialize)(mbc_t *mbc, void *data, size_t size);
+	size_t (*unserialize)(mbc_t *mbc, const void *data, size_t size);
+} mbc_mapper_t;
+
+struct mbc
 {
+	const mbc_mapper_t *mapper;
+	uint16_t mapper_id;
+	uint8_t submapper;
+	mem_t *mem;
+	cpu_t *cpu;
 	uint8_t *data;
 	size_t size;
 	struct ines *ines;
@@ -31,15 +60,80 @@ typedef struct mbc
 	size_t prg_rom_size;
 	uint8_t *chr_rom_data;
 	size_t chr_rom_size;
-} mbc_t;
+	uint8_t *chr_data;
+	size_t chr_size;
+	uint8_t *prg_banks[4];
+	uint8_t *chr_banks[8];
+	uint32_t chr_tile_banks[8];
+	uint8_t *chr_tiles;
+	uint8_t *chr_dirty;
+	uint8_t regs[8];
+	uint8_t ctrl;
+	uint8_t shift;
+	uint8_t irq_latch;
+	uint8_t irq_counter;
+	uint8_t irq_reload;
+	uint8_t irq_enable;
+	uint8_t prg_ram[0x2000];
+	uint8_t chr_ram[0x2000];
+};
 
 mbc_t *mbc_new(const void *data, size_t size);
 void mbc_del(mbc_t *mbc);
 
-uint8_t mbc_get(mbc_t *mbc, uint16_t addr);
-void mbc_set(mbc_t *mbc, uint16_t addr, uint8_t v);
+void mbc_chr_decode(mbc_t *mbc, uint32_t tile);
+
+size_t mbc_serialize(mbc_t *mbc, void *data, size_t size);
+size_t mbc_unserialize(mbc_t *mbc, const void *data, size_t size);
 
-uint8_t mbc_gpu_get(mbc_t *mbc, uint16_t addr);
-void mbc_gpu_set(mbc_t *mbc, uint16_t addr, uint8_t v);
+static inline void mbc_map(mbc_t *mbc)
+{
+	mbc->mapper->map(mbc);
+}
+
+static inline void mbc_scanline(mbc_t *mbc)
+{
+	if (mbc->mapper->scanline)
+		mbc->mapper->scanline(mbc);
+}
+
+static inline int mbc_irq(mbc_t *mbc)
+{
+	if (mbc->mapper->irq)
+		return mbc->mapper->irq(mbc);
+	return -1;
+}
+
+static inline uint8_t mbc_get(mbc_t *mbc, uint16_t addr)
+{
+	return mbc->mapper->get(mbc, addr);
+}
+
+static inline void mbc_set(mbc_t *mbc, uint16_t addr, uint8_t v)
+{
+	mbc->mapper->set(mbc, addr, v);
+}
+
+static inline uint8_t mbc_gpu_get(mbc_t *mbc, uint16_t addr)
+{
+	return mbc->mapper->gpu_get(mbc, addr);
+}
+
+static inline void mbc_gpu_set(mbc_t *mbc, uint16_t addr, uint8_t v)
+{
+	mbc->mapper->gpu_set(mbc, addr, v);
+}
+
+/* decoded 64 bytes tile at the given pattern table address, rebuilt on
+ * first use after a chr ram write
+ */
+static inline const uint8_t *mbc_chr_tile(mbc_t *mbc, uint16_t addr, int flip)
+{
+	uint32_t tile = mbc->chr_tile_banks[(addr >> 10) & 0x7]
+	              + ((addr >> 4) & 0x3F);
+	if (mbc->chr_dirty[tile])
+		mbc_chr_decode(mbc, tile);
+	return &mbc->chr_tiles[tile * 128 + (flip ? 64 : 0)];
+}
 
 #endif
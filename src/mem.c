@@ -1,7 +1,12 @@
 #include "mem.h"
 #include "mbc.h"
+#include "gpu.h"
+#include "apu.h"
+#include "cpu.h"
+#include "cpu/block.h"
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdio.h>
 
 mem_t *mem_new(mbc_t *mbc)
@@ -10,6 +15,10 @@ mem_t *mem_new(mbc_t *mbc)
 	if (!mem)
 		return NULL;
 	mem->mbc = mbc;
+	mbc->mem = mem;
+	for (uint16_t addr = 0; addr < 0x2000; addr += sizeof(mem->wram))
+		mem_map(mem, addr, sizeof(mem->wram), mem->wram, mem->wram);
+	mbc_map(mbc);
 	return mem;
 }
 
@@ -20,16 +29,117 @@ void mem_del(mem_t *mem)
 	free(mem);
 }
 
-uint8_t mem_get(mem_t *mem, uint16_t addr)
+/* size and addr must be page aligned, a NULL data sends the pages back to
+ * the io handlers
+ */
+void mem_map(mem_t *mem, uint16_t addr, uint32_t size, uint8_t *rdata,
+             uint8_t *wdata)
 {
-#if 0
-	printf("get [0x%04" PRIx16 "]\n", addr);
+	size_t page = addr >> MEM_PAGE_SHIFT;
+	for (uint32_t i = 0; i < size; i += MEM_PAGE_SIZE, page++)
+		mem->rpages[page] = rdata ? &rdata[i] : NULL;
+	page = addr >> MEM_WPAGE_SHIFT;
+	for (uint32_t i = 0; i < size; i += MEM_WPAGE_SIZE, page++)
+	{
+		mem->wpages[page] = wdata ? &wdata[i] : NULL;
+		mem->code_pages[page] = NULL;
+#ifdef CPU_BLOCK
+		/* a page holding cpu blocks stays protected wherever it's mapped */
+		if (wdata && mem->cpu
+		 && cpu_block_protected(mem->cpu->blocks, &wdata[i]))
+		{
+			mem->code_pages[page] = &wdata[i];
+			mem->wpages[page] = NULL;
+		}
 #endif
-	if (addr < 0x2000)
+	}
+}
+
+/* writes to a protected wpage reach mem_io_set, which passes them on to the
+ * cpu blocks decoded from it
+ */
+void mem_protect(mem_t *mem, uint8_t *data, int protect)
+{
+	for (size_t page = 0; page < MEM_WPAGE_COUNT; ++page)
+	{
+		if (protect && mem->wpages[page] == data)
+		{
+			mem->code_pages[page] = data;
+			mem->wpages[page] = NULL;
+		}
+		else if (!protect && mem->code_pages[page] == data)
+		{
+			mem->wpages[page] = data;
+			mem->code_pages[page] = NULL;
+		}
+	}
+}
+
+void mem_gpu_map(mem_t *mem, uint16_t addr, uint32_t size, uint8_t *data)
+{
+	size_t page = addr >> MEM_PAGE_SHIFT;
+	for (uint32_t i = 0; i < size; i += MEM_PAGE_SIZE, page++)
+		mem->gpu_pages[page] = data ? &data[i] : NULL;
+}
+
+/* nametables live at 0x2000-0x2FFF and are mirrored at 0x3000-0x3EFF */
+void mem_gpu_mirror(mem_t *mem, enum mem_mirror mirror)
+{
+	static const uint8_t tables[5][4] =
+	{
+		[MEM_MIRROR_HORIZONTAL] = {0, 0, 1, 1},
+		[MEM_MIRROR_VERTICAL]   = {0, 1, 0, 1},
+		[MEM_MIRROR_SINGLE0]    = {0, 0, 0, 0},
+		[MEM_MIRROR_SINGLE1]    = {1, 1, 1, 1},
+		[MEM_MIRROR_FOUR]       = {0, 1, 2, 3},
+	};
+	for (uint8_t i = 0; i < 4; ++i)
+	{
+		uint8_t *data = &mem->gpu_names[tables[mirror][i] * 0x400];
+		mem->gpu_pages[0x8 + i] = data;
+		mem->gpu_pages[0xC + i] = data;
+	}
+}
+
+/* the copy starts at the current oam address and wraps around, pages backed
+ * by memory are copied in one go, io pages go through the handlers
+ */
+static void mem_oam_dma(mem_t *mem, uint8_t v)
+{
+	uint16_t src = (uint16_t)v << 8;
+	uint8_t *page = mem->rpages[src >> MEM_PAGE_SHIFT];
+	uint8_t tmp[0x100];
+	const uint8_t *data;
+	if (page)
+	{
+		data = &page[src & MEM_PAGE_MASK];
+	}
+	else
 	{
-		addr &= 0x7FF;
-		return mem->wram[addr];
+		for (size_t i = 0; i < sizeof(tmp); ++i)
+			tmp[i] = mem_io_get(mem, src + i);
+		data = tmp;
 	}
+	if (mem->gpu)
+		gpu_catchup(mem->gpu);
+	uint8_t n = mem->spram_addr;
+	memcpy(&mem->gpu_oam[n], data, 0x100 - n);
+	memcpy(mem->gpu_oam, &data[0x100 - n], n);
+	/* one halt cycle, one more to align on a get cycle, then 256 get / put
+	 * pairs, the halt comes right after the write, which is the last cycle
+	 * of the instruction while cycles still counts from its start
+	 */
+	if (mem->cpu)
+		cpu_stall(mem->cpu, 513 + ((mem->cpu->cycles
+		                          + mem->cpu->instr_cycles) & 1));
+}
+
+uint8_t mem_io_get(mem_t *mem, uint16_t addr)
+{
+#if 0
+	printf("get [0x%04" PRIx16 "]\n", addr);
+#endif
+	mem->io_count++;
 	if (addr < 0x4000)
 	{
 		addr &= 7;
@@ -42,66 +152,98 @@ uint8_t mem_get(mem_t *mem, uint16_t addr)
 			case 0x6:
 				printf("read from RO gpu register 0x200%" PRIx16 "\n", addr);
 				return 0;
+			case 0x2:
+				mem->vram_ff = 0;
+				return mem->gpu ? gpu_status(mem->gpu) : 0;
 			case 0x4:
-				return mem_gpu_get(mem, mem->spram_addr);
+				if (mem->gpu)
+					gpu_catchup(mem->gpu);
+				return mem->gpu_oam[mem->spram_addr];
 			case 0x7:
 			{
+				if (mem->gpu)
+					gpu_catchup(mem->gpu);
 				uint8_t v = mem_gpu_get(mem, mem->vram_addr);
-				mem->vram_addr += (mem->gpu_regs[0x0] & 0x40) ? 32 : 1;
-				mem->vram_addr &= 0x3FFF;
+				mem->vram_addr += (mem->gpu_regs[0x0] & 0x04) ? 32 : 1;
+				mem->vram_addr &= 0x7FFF;
 				return v;
 			}
-			default:
-				return mem->gpu_regs[addr];
 		}
 	}
 	if (addr < 0x4018)
 	{
-		/* XXX APU IO */
+		if (addr == 0x4015)
+			return apu_get(mem->apu, addr);
+		/* XXX joypad */
 		return 0;
 	}
 	return mbc_get(mem->mbc, addr);
 }
 
-void mem_set(mem_t *mem, uint16_t addr, uint8_t v)
+void mem_io_set(mem_t *mem, uint16_t addr, uint8_t v)
 {
-#if 1
-		printf("set [0x%04" PRIx16 "] = %02" PRIx8 "\n", addr, v);
+#if 0
+	printf("set [0x%04" PRIx16 "] = %02" PRIx8 "\n", addr, v);
 #endif
-	if (addr < 0x2000)
+	uint8_t *code = mem->code_pages[addr >> MEM_WPAGE_SHIFT];
+	if (code)
 	{
-		addr &= 0x7FF;
-		mem->wram[addr] = v;
+		code[addr & MEM_WPAGE_MASK] = v;
+#ifdef CPU_BLOCK
+		cpu_block_write(mem->cpu->blocks, &code[addr & MEM_WPAGE_MASK]);
+#endif
 		return;
 	}
+	mem->io_count++;
 	if (addr < 0x4000)
 	{
 		addr &= 0x7;
+		if (mem->gpu)
+			gpu_catchup(mem->gpu);
 		switch (addr)
 		{
 			case 0x0:
+				mem->gpu_regs[addr] = v;
+				mem->vram_tmp = (mem->vram_tmp & ~0x0C00)
+				              | ((uint16_t)(v & 0x3) << 10);
+				return;
 			case 0x1:
 				mem->gpu_regs[addr] = v;
+				if (mem->gpu)
+					gpu_schedule(mem->gpu);
 				return;
 			case 0x5:
-				/* XXX */
+				if (mem->vram_ff)
+					mem->vram_tmp = (mem->vram_tmp & ~0x73E0)
+					              | ((uint16_t)(v & 0x07) << 12)
+					              | ((uint16_t)(v & 0xF8) << 2);
+				else
+				{
+					mem->vram_tmp = (mem->vram_tmp & ~0x001F) | (v >> 3);
+					mem->fine_x = v & 0x7;
+				}
+				mem->vram_ff = !mem->vram_ff;
 				return;
 			case 0x3:
 				mem->spram_addr = v;
 				return;
 			case 0x4:
-				mem_gpu_set(mem, mem->spram_addr, v);
-				mem->spram_addr++;
+				mem->gpu_oam[mem->spram_addr++] = v;
 				return;
 			case 0x6:
 #if 0
 				printf("writing VRAM addr %02" PRIx8 " (%d)\n", v, mem->vram_ff);
 #endif
 				if (mem->vram_ff)
-					mem->vram_addr = (mem->vram_addr & 0x3F00) | v;
+				{
+					mem->vram_tmp = (mem->vram_tmp & 0x7F00) | v;
+					mem->vram_addr = mem->vram_tmp;
+				}
 				else
-					mem->vram_addr = (mem->vram_addr & 0xFF)
-					               | ((uint16_t)(v & 0x3F) << 8);
+				{
+					mem->vram_tmp = (mem->vram_tmp & 0x00FF)
+					              | ((uint16_t)(v & 0x3F) << 8);
+				}
 				mem->vram_ff = !mem->vram_ff;
 				return;
 			case 0x2:
@@ -111,37 +253,44 @@ void mem_set(mem_t *mem, uint16_t addr, uint8_t v)
 				return;
 			case 0x7:
 				mem_gpu_set(mem, mem->vram_addr, v);
-				mem->vram_addr += (mem->gpu_regs[0x0] & 0x40) ? 32 : 1;
-				mem->vram_addr &= 0x3FFF;
+				mem->vram_addr += (mem->gpu_regs[0x0] & 0x04) ? 32 : 1;
+				mem->vram_addr &= 0x7FFF;
 				return;
 		}
 		return;
 	}
 	if (addr < 0x4018)
 	{
-		/* XXX APU IO */
+		if (addr == 0x4014)
+		{
+			mem_oam_dma(mem, v);
+			return;
+		}
+		if (addr == 0x4016)
+		{
+			/* XXX joypad */
+			return;
+		}
+		apu_set(mem->apu, addr, v);
 		return;
 	}
+	/* bank and irq changes apply from the current dot */
+	if (mem->gpu)
+		gpu_catchup(mem->gpu);
 	mbc_set(mem->mbc, addr, v);
+	if (mem->gpu)
+		gpu_schedule(mem->gpu);
 }
 
 uint8_t mem_gpu_get(mem_t *mem, uint16_t addr)
 {
-	switch (addr >> 12)
-	{
-		case 0x0:
-		case 0x1:
-			return mbc_gpu_get(mem->mbc, addr);
-		case 0x2:
-			return mem->gpu_names[addr - 0x2000];
-		case 0x3:
-			if (addr < 0x3F00)
-				return mem->gpu_names[addr - 0x3000];
-			return mem->gpu_palettes[(addr - 0x3F00) & 0x1F];
-		default:
-			printf("get unknown gpu memory %04" PRIx16 "\n", addr);
-			return 0;
-	}
+	addr &= 0x3FFF;
+	if (addr >= 0x3F00)
+		return mem->gpu_palettes[addr & 0x1F];
+	uint8_t *page = mem->gpu_pages[addr >> MEM_PAGE_SHIFT];
+	if (page)
+		return page[addr & MEM_PAGE_MASK];
+	return mbc_gpu_get(mem->mbc, addr);
 }
 
 void mem_gpu_set(mem_t *mem, uint16_t addr, uint8_t v)
@@ -149,24 +298,16 @@ void mem_gpu_set(mem_t *mem, uint16_t addr, uint8_t v)
 #if 0
 	printf("gpu set [0x%04" PRIx16 "] = %02" PRIx8 "\n", addr, v);
 #endif
-	switch (addr >> 12)
+	addr &= 0x3FFF;
+	if (addr >= 0x3F00)
 	{
-		case 0x0:
-		case 0x1:
-			mbc_gpu_set(mem->mbc, addr, v);
-			break;
-		case 0x2:
-			mem->gpu_names[addr - 0x2000] = v;
-			break;
-		case 0x3:
-			if (addr < 0x3EFF)
-				mem->gpu_names[addr - 0x3000] = v;
-			else
-				mem->gpu_palettes[(addr - 0x3F00) & 0x1F] = v;
-			break;
-		default:
-			printf("set unknown gpu memory %04" PRIx16 " = %02" PRIx8 "\n",
-			       addr, v);
-			return;
+		mem->gpu_palettes[addr & 0x1F] = v;
+		return;
+	}
+	if (addr < 0x2000)
+	{
+		mbc_gpu_set(mem->mbc, addr, v);
+		return;
 	}
+	mem->gpu_pages[addr >> MEM_PAGE_SHIFT][addr & MEM_PAGE_MASK] = v;
 }
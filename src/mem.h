@@ -12,25 +12,92 @@
 #define MEM_REG_GPU_VRAM_ADDR    0x2006
 #define MEM_REG_GPU_VRAM_DATA    0x2007
 
+#define MEM_PAGE_SHIFT 10
+#define MEM_PAGE_SIZE  (1 << MEM_PAGE_SHIFT)
+#define MEM_PAGE_MASK  (MEM_PAGE_SIZE - 1)
+#define MEM_PAGE_COUNT (0x10000 >> MEM_PAGE_SHIFT)
+
+#define MEM_WPAGE_SHIFT 8
+#define MEM_WPAGE_SIZE  (1 << MEM_WPAGE_SHIFT)
+#define MEM_WPAGE_MASK  (MEM_WPAGE_SIZE - 1)
+#define MEM_WPAGE_COUNT (0x10000 >> MEM_WPAGE_SHIFT)
+
 typedef struct mbc mbc_t;
+typedef struct gpu gpu_t;
+typedef struct apu apu_t;
+typedef struct cpu cpu_t;
+
+enum mem_mirror
+{
+	MEM_MIRROR_HORIZONTAL,
+	MEM_MIRROR_VERTICAL,
+	MEM_MIRROR_SINGLE0,
+	MEM_MIRROR_SINGLE1,
+	MEM_MIRROR_FOUR,
+};
 
+/* rpages / wpages map each 1KiB page of the cpu bus to its backing memory,
+ * NULL pages are dispatched to the io handlers
+ * wpages are only 256 bytes so that write protecting code in ram leaves the
+ * zero page and the stack alone
+ * gpu_pages does the same for the 0x0000-0x3EFF gpu bus (chr + nametables)
+ * code_pages holds the wpages taken out by mem_protect
+ */
 typedef struct mem
 {
+	uint8_t *rpages[MEM_PAGE_COUNT];
+	uint8_t *wpages[MEM_WPAGE_COUNT];
+	uint8_t *code_pages[MEM_WPAGE_COUNT];
+	uint8_t *gpu_pages[16];
 	mbc_t *mbc;
+	gpu_t *gpu;
+	apu_t *apu;
+	cpu_t *cpu;
 	uint8_t gpu_regs[7];
 	uint8_t wram[0x800];
 	uint8_t gpu_names[0x1000];
 	uint8_t gpu_palettes[0x20];
+	uint8_t gpu_oam[0x100];
+	/* v, t, x and w of the gpu scroll logic */
 	uint16_t vram_addr;
-	uint8_t spram_addr;
+	uint16_t vram_tmp;
+	uint8_t fine_x;
 	uint8_t vram_ff;
+	uint8_t spram_addr;
+	uint32_t io_count; /* lets cpu blocks notice the side effects of io */
 } mem_t;
 
 mem_t *mem_new(mbc_t *mbc);
 void mem_del(mem_t *mem);
 
-uint8_t mem_get(mem_t *mem, uint16_t addr);
-void mem_set(mem_t *mem, uint16_t addr, uint8_t v);
+void mem_map(mem_t *mem, uint16_t addr, uint32_t size, uint8_t *rdata,
+             uint8_t *wdata);
+void mem_protect(mem_t *mem, uint8_t *data, int protect);
+
+void mem_gpu_map(mem_t *mem, uint16_t addr, uint32_t size, uint8_t *data);
+void mem_gpu_mirror(mem_t *mem, enum mem_mirror mirror);
+
+uint8_t mem_io_get(mem_t *mem, uint16_t addr);
+void mem_io_set(mem_t *mem, uint16_t addr, uint8_t v);
+
+static inline uint8_t mem_get(mem_t *mem, uint16_t addr)
+{
+	uint8_t *page = mem->rpages[addr >> MEM_PAGE_SHIFT];
+	if (page)
+		return page[addr & MEM_PAGE_MASK];
+	return mem_io_get(mem, addr);
+}
+
+static inline void mem_set(mem_t *mem, uint16_t addr, uint8_t v)
+{
+	uint8_t *page = mem->wpages[addr >> MEM_WPAGE_SHIFT];
+	if (page)
+	{
+		page[addr & MEM_WPAGE_MASK] = v;
+		return;
+	}
+	mem_io_set(mem, addr, v);
+}
 
 uint8_t mem_gpu_get(mem_t *mem, uint16_t addr);
 void mem_gpu_set(mem_t *mem, uint16_t addr, uint8_t v);
@@ -1,11 +1,12 @@
 #include "nes.h"
+#include "sched.h"
 #include "mbc.h"
 #include "mem.h"
 #include "apu.h"
+#include "apu/blip.h"
 #include "cpu.h"
 #include "gpu.h"
 #include <stdlib.h>
-#include <string.h>
 
 nes_t *nes_new(const void *rom_data, size_t rom_size)
 {
@@ -13,6 +14,10 @@ nes_t *nes_new(const void *rom_data, size_t rom_size)
 	if (!nes)
 		return NULL;
 
+	nes->sched = sched_new();
+	if (!nes->sched)
+		return NULL;
+
 	nes->mbc = mbc_new(rom_data, rom_size);
 	if (!nes->mbc)
 		return NULL;
@@ -28,11 +33,22 @@ nes_t *nes_new(const void *rom_data, size_t rom_size)
 	nes->cpu = cpu_new(nes->mem);
 	if (!nes->cpu)
 		return NULL;
+	nes->mbc->cpu = nes->cpu;
+	nes->apu->cpu = nes->cpu;
+	nes->apu->sched = nes->sched;
+	nes->cpu->sched = nes->sched;
+	nes->mem->apu = nes->apu;
+	nes->mem->cpu = nes->cpu;
 
 	nes->gpu = gpu_new(nes, nes->mem);
 	if (!nes->gpu)
 		return NULL;
+	nes->mem->gpu = nes->gpu;
 
+	sched_set(nes->sched, SCHED_CPU, 0);
+	sched_set(nes->sched, SCHED_NMI, 341 * 240 * GPU_CLOCK_DIVIDER);
+	sched_set(nes->sched, SCHED_FRAME, NES_FRAME_CLOCKS);
+	apu_schedule(nes->apu);
 	return nes;
 }
 
@@ -45,16 +61,77 @@ void nes_del(nes_t *nes)
 	apu_del(nes->apu);
 	mem_del(nes->mem);
 	mbc_del(nes->mbc);
+	sched_del(nes->sched);
 	free(nes);
 }
 
-void nes_frame(nes_t *nes, uint8_t *video_buf, int16_t *audio_buf, uint32_t joypad)
+static int nes_event(nes_t *nes, enum sched_event event)
+{
+	sched_t *sched = nes->sched;
+	switch (event)
+	{
+		case SCHED_CPU:
+			/* run the cpu up to the next pending event in one slice, the
+			 * events set while it runs can pull the end of the slice in
+			 */
+			sched->until = sched_until(sched, SCHED_CPU);
+			sched->events[SCHED_CPU] += cpu_run(nes->cpu) * CPU_CLOCK_DIVIDER;
+			return 0;
+		case SCHED_APU:
+			/* the irq is raised by the step at the event cycle */
+			apu_sync(nes->apu, sched->clock / CPU_CLOCK_DIVIDER + 1);
+			return 0;
+		case SCHED_MBC_IRQ:
+			/* the scanline clock raising the irq happens in the sync */
+			gpu_sync(nes->gpu, sched->clock);
+			gpu_schedule(nes->gpu);
+			return 0;
+		case SCHED_NMI:
+			if (mem_get_gpu_reg(nes->mem, MEM_REG_GPU_RC1) & 0x80)
+				cpu_nmi(nes->cpu);
+			sched->events[SCHED_NMI] += NES_FRAME_CLOCKS;
+			return 0;
+		case SCHED_FRAME:
+			gpu_sync(nes->gpu, sched->clock);
+			sched->events[SCHED_FRAME] += NES_FRAME_CLOCKS;
+			return 1;
+		default:
+			return 1;
+	}
+}
+
+size_t nes_frame(nes_t *nes, void *video_buf, size_t video_pitch,
+                 enum nes_video_format video_format, int16_t *audio_buf,
+                 size_t audio_size, uint32_t joypad)
 {
-	for (size_t i = 0 ; i < 357368; ++i) /* 532034 in PAL */
+	sched_t *sched = nes->sched;
+	while (1)
 	{
-		cpu_clock(nes->cpu);
-		gpu_clock(nes->gpu);
+		enum sched_event event = sched_next(sched);
+		sched->clock = sched->events[event];
+		if (nes_event(nes, event))
+			break;
 	}
-	memcpy(video_buf, nes->gpu->data, 256 * 240 * 4);
-	memset(audio_buf, 0, 960 * 2);
+	if (video_buf)
+	{
+		static const enum gpu_format formats[] =
+		{
+			[NES_VIDEO_XRGB8888] = GPU_FORMAT_XRGB8888,
+			[NES_VIDEO_RGB565]   = GPU_FORMAT_RGB565,
+			[NES_VIDEO_INDEX]    = GPU_FORMAT_INDEX,
+		};
+		gpu_convert(nes->gpu, video_buf, video_pitch, formats[video_format]);
+	}
+	return apu_frame(nes->apu, sched->clock / CPU_CLOCK_DIVIDER, audio_buf,
+	                 audio_size);
+}
+
+int nes_set_audio_rate(nes_t *nes, double rate)
+{
+	return apu_blip_set_rates(nes->apu->blip, APU_CLOCK_RATE, rate);
+}
+
+const uint8_t *nes_video(nes_t *nes)
+{
+	return nes->gpu->data;
 }
@@ -4,6 +4,11 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#define NES_MASTER_CLOCK 21477272 /* 26601712 in PAL */
+#define NES_FRAME_CLOCKS 357368 /* 532034 in PAL */
+#define NES_FPS ((double)NES_MASTER_CLOCK / NES_FRAME_CLOCKS)
+
+typedef struct sched sched_t;
 typedef struct mbc mbc_t;
 typedef struct mem mem_t;
 typedef struct apu apu_t;
@@ -22,8 +27,16 @@ enum nes_button
 	NES_BUTTON_START  = (1 << 7),
 };
 
+enum nes_video_format
+{
+	NES_VIDEO_XRGB8888,
+	NES_VIDEO_RGB565,
+	NES_VIDEO_INDEX, /* 6-bit colour per pixel */
+};
+
 typedef struct nes
 {
+	sched_t *sched;
 	mbc_t *mbc;
 	mem_t *mem;
 	apu_t *apu;
@@ -34,6 +47,24 @@ typedef struct nes
 nes_t *nes_new(const void *rom_data, size_t rom_size);
 void nes_del(nes_t *nes);
 
-void nes_frame(nes_t *nes, uint8_t *video_buf, int16_t *audio_buf, uint32_t joypad);
+/* the frame is converted straight into video_buf (256x240, video_pitch bytes
+ * per line), a NULL video_buf skips the conversion
+ * up to audio_size mono samples are written to audio_buf at the rate given
+ * to nes_set_audio_rate (48000 by default), the fractional part of the
+ * frame is carried to the next one, returns the number of samples
+ */
+size_t nes_frame(nes_t *nes, void *video_buf, size_t video_pitch,
+                 enum nes_video_format video_format, int16_t *audio_buf,
+                 size_t audio_size, uint32_t joypad);
+
+/* returns -1 and keeps the previous rate if rate isn't below the apu clock
+ * or can't be buffered
+ */
+int nes_set_audio_rate(nes_t *nes, double rate);
+
+/* colour indexes of the last frame, 256 bytes per line, valid until the
+ * next nes_frame
+ */
+const uint8_t *nes_video(nes_t *nes);
 
 #endif
@@ -0,0 +1,19 @@
+#include "sched.h"
+#include <stdlib.h>
+
+sched_t *sched_new(void)
+{
+	sched_t *sched = calloc(sizeof(*sched), 1);
+	if (!sched)
+		return NULL;
+	for (size_t i = 0; i < SCHED_EVENT_COUNT; ++i)
+		sched->events[i] = SCHED_NEVER;
+	return sched;
+}
+
+void sched_del(sched_t *sched)
+{
+	if (!sched)
+		return;
+	free(sched);
+}
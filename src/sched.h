@@ -0,0 +1,63 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+
+#define SCHED_NEVER UINT64_MAX
+
+enum sched_event
+{
+	SCHED_CPU,
+	SCHED_APU,
+	SCHED_MBC_IRQ,
+	SCHED_NMI,
+	SCHED_FRAME,
+	SCHED_EVENT_COUNT,
+};
+
+/* every timestamp is expressed in master clock cycles */
+typedef struct sched
+{
+	uint64_t clock;
+	uint64_t until; /* end of the running cpu slice */
+	uint64_t events[SCHED_EVENT_COUNT];
+} sched_t;
+
+sched_t *sched_new(void);
+void sched_del(sched_t *sched);
+
+static inline void sched_set(sched_t *sched, enum sched_event event,
+                             uint64_t clock)
+{
+	sched->events[event] = clock;
+	/* an event landing inside the running cpu slice cuts it short */
+	if (clock < sched->until)
+		sched->until = clock;
+}
+
+/* on equal timestamps, the lowest event id runs first */
+static inline enum sched_event sched_next(const sched_t *sched)
+{
+	enum sched_event next = 0;
+	for (int i = 1; i < SCHED_EVENT_COUNT; ++i)
+	{
+		if (sched->events[i] < sched->events[next])
+			next = i;
+	}
+	return next;
+}
+
+/* earliest timestamp of every event but the given one */
+static inline uint64_t sched_until(const sched_t *sched,
+                                   enum sched_event except)
+{
+	uint64_t until = SCHED_NEVER;
+	for (int i = 0; i < SCHED_EVENT_COUNT; ++i)
+	{
+		if (i != (int)except && sched->events[i] < until)
+			until = sched->events[i];
+	}
+	return until;
+}
+
+#endif